@@ -0,0 +1,298 @@
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "los.h"
+#include "los_signal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef SIGUSR1
+#define BENCH_SIGNAL SIGUSR1
+#else
+#define BENCH_SIGNAL SIGINT
+#endif
+
+#define BENCH_ITERATIONS 20000000
+#define BENCH_SIGNAL_EVERY 1000
+#define BENCH_LATENCY_SAMPLES 100000
+#define BENCH_SUSTAINED_SECONDS 1
+#define BENCH_CWD_CALLS 1000000
+#define BENCH_SLEEP_CALLS 200
+#define BENCH_SLEEP_US 100
+
+static double now_s(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static lua_State *bench_state(void)
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	luaopen_eli_os_signal(L);
+	lua_setglobal(L, "signal");
+	luaopen_eli_os_extra(L);
+	lua_setglobal(L, "osx");
+	return L;
+}
+
+// runs chunk with (...) = sig, arg and leaves nresults on the stack,
+// returns 0 on error
+static int bench_eval(lua_State *L, const char *chunk, lua_Integer arg,
+		      int nresults)
+{
+	if (luaL_loadstring(L, chunk) != LUA_OK) {
+		fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return 0;
+	}
+	lua_pushinteger(L, BENCH_SIGNAL);
+	lua_pushinteger(L, arg);
+	if (lua_pcall(L, 2, nresults, 0) != LUA_OK) {
+		fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return 0;
+	}
+	return 1;
+}
+
+// runs chunk with (...) = args and returns elapsed seconds, -1 on error
+static double bench_run(lua_State *L, const char *chunk, const char *mode,
+			lua_Integer count)
+{
+	if (luaL_loadstring(L, chunk) != LUA_OK) {
+		fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return -1;
+	}
+	lua_pushstring(L, mode);
+	lua_pushinteger(L, count);
+	lua_pushinteger(L, BENCH_SIGNAL);
+	lua_pushinteger(L, BENCH_ITERATIONS);
+	lua_pushinteger(L, BENCH_SIGNAL_EVERY);
+	double start = now_s();
+	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+		fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return -1;
+	}
+	return now_s() - start;
+}
+
+/*
+** Interpreter throughput of a tight loop raising a signal every
+** BENCH_SIGNAL_EVERY iterations, for each of the dispatch modes.
+*/
+static const char *dispatch_chunk =
+	"local mode, count, sig, n, every = ...\n"
+	"local hits = 0\n"
+	"if mode ~= 'none' then\n"
+	"  signal.handle(sig, function() hits = hits + 1 end)\n"
+	"  signal.set_dispatch(mode, count)\n"
+	"end\n"
+	"local poll = mode == 'poll'\n"
+	"local x = 0\n"
+	"for i = 1, n do\n"
+	"  x = x + i % 7\n"
+	"  if i % every == 0 and mode ~= 'none' then\n"
+	"    signal.raise(sig)\n"
+	"    if poll then signal.dispatch() end\n"
+	"  end\n"
+	"end\n"
+	"if mode ~= 'none' then\n"
+	"  signal.set_dispatch('poll'); signal.dispatch()\n"
+	"  signal.reset(sig); signal.set_dispatch('hook')\n"
+	"end\n";
+
+static void bench_dispatch_modes(void)
+{
+	static const struct {
+		const char *mode;
+		lua_Integer count;
+	} cases[] = {
+		{ "none", 1 },	 { "hook", 1 },	   { "count", 1 },
+		{ "count", 100 }, { "count", 1000 }, { "poll", 1 },
+	};
+
+	printf("dispatch modes (%d iterations, signal every %d)\n",
+	       BENCH_ITERATIONS, BENCH_SIGNAL_EVERY);
+	printf("  %-6s %-6s %18s %9s\n", "mode", "count", "throughput",
+	       "overhead");
+	double baseline = 0;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		lua_State *L = bench_state();
+		double elapsed =
+			bench_run(L, dispatch_chunk, cases[i].mode,
+				  cases[i].count);
+		lua_close(L);
+		if (elapsed < 0) {
+			continue;
+		}
+		if (i == 0) {
+			baseline = elapsed;
+		}
+		printf("  %-6s %-6lld %10.2f Miter/s %8.2f%%\n", cases[i].mode,
+		       (long long)cases[i].count,
+		       BENCH_ITERATIONS / elapsed / 1e6,
+		       baseline > 0 ? (elapsed / baseline - 1) * 100 : 0.0);
+	}
+}
+
+/*
+** Time from signal.raise to the first instruction of the lua handler,
+** with the hook dispatch and with explicit signal.dispatch().
+*/
+static const char *latency_chunk =
+	"local sig, n = ...\n"
+	"local now, t0, samples = osx.monotonic_ns, 0, {}\n"
+	"signal.handle(sig, function() samples[#samples + 1] = now() - t0 end)\n"
+	"local function pct(p)\n"
+	"  return samples[math.max(1, math.ceil(#samples * p))] or 0\n"
+	"end\n"
+	"local results = {}\n"
+	"for _, mode in ipairs({ 'hook', 'poll' }) do\n"
+	"  samples = {}\n"
+	"  signal.set_dispatch(mode)\n"
+	"  local poll = mode == 'poll'\n"
+	"  for _ = 1, n do\n"
+	"    t0 = now()\n"
+	"    signal.raise(sig)\n"
+	"    if poll then signal.dispatch() end\n"
+	"  end\n"
+	"  table.sort(samples)\n"
+	"  results[#results + 1] = pct(0.5)\n"
+	"  results[#results + 1] = pct(0.99)\n"
+	"end\n"
+	"signal.reset(sig); signal.set_dispatch('hook')\n"
+	"return table.unpack(results)\n";
+
+static void bench_latency(void)
+{
+	static const char *modes[] = { "hook", "poll" };
+	lua_State *L = bench_state();
+	printf("raise to handler latency (%d samples)\n", BENCH_LATENCY_SAMPLES);
+	if (bench_eval(L, latency_chunk, BENCH_LATENCY_SAMPLES, 4)) {
+		for (int i = 0; i < 2; i++) {
+			printf("  %-6s p50 %8lld ns  p99 %8lld ns\n", modes[i],
+			       (long long)lua_tointeger(L, -4 + i * 2),
+			       (long long)lua_tointeger(L, -3 + i * 2));
+		}
+		lua_pop(L, 4);
+	}
+	lua_close(L);
+}
+
+/*
+** Sustained rate of raise + hook dispatch and the largest burst which
+** fits the queue (raised without dispatching) before signals get dropped.
+*/
+static const char *throughput_chunk =
+	"local sig, seconds = ...\n"
+	"local now, handled = osx.monotonic_ns, 0\n"
+	"signal.handle(sig, function() handled = handled + 1 end)\n"
+	"local dropped = signal.dropped()\n"
+	"local start = now()\n"
+	"local deadline = start + seconds * 1000000000\n"
+	"while now() < deadline do\n"
+	"  for _ = 1, 100 do signal.raise(sig) end\n"
+	"end\n"
+	"signal.set_dispatch('poll'); signal.dispatch()\n"
+	"local rate = handled / ((now() - start) / 1e9)\n"
+	"local sustained_drops = signal.dropped() - dropped\n"
+	"local burst, max_burst = 1, 0\n"
+	"while burst <= 1 << 20 do\n"
+	"  dropped = signal.dropped()\n"
+	"  for _ = 1, burst do signal.raise(sig) end\n"
+	"  signal.dispatch()\n"
+	"  if signal.dropped() ~= dropped then break end\n"
+	"  max_burst = burst\n"
+	"  burst = burst * 2\n"
+	"end\n"
+	"signal.reset(sig); signal.set_dispatch('hook')\n"
+	"return math.floor(rate), sustained_drops, max_burst\n";
+
+static void bench_throughput(void)
+{
+	lua_State *L = bench_state();
+	printf("signal throughput (%d s)\n", BENCH_SUSTAINED_SECONDS);
+	if (bench_eval(L, throughput_chunk, BENCH_SUSTAINED_SECONDS, 3)) {
+		printf("  sustained %12lld signals/s (%lld dropped)\n",
+		       (long long)lua_tointeger(L, -3),
+		       (long long)lua_tointeger(L, -2));
+		printf("  max burst %12lld signals without drops\n",
+		       (long long)lua_tointeger(L, -1));
+		lua_pop(L, 3);
+	}
+	lua_close(L);
+}
+
+/*
+** Per call cost of os.cwd (cached) and os.sleep(0), and how much a short
+** os.sleep overshoots the requested duration.
+*/
+static const char *os_chunk =
+	"local _, n = ...\n"
+	"local now = osx.monotonic_ns\n"
+	"local start = now()\n"
+	"for _ = 1, n do osx.cwd() end\n"
+	"local cwd_ns = (now() - start) // n\n"
+	"local m = n // 100\n"
+	"start = now()\n"
+	"for _ = 1, m do osx.sleep(0) end\n"
+	"local sleep0_ns = (now() - start) // m\n"
+	"local total, worst = 0, 0\n"
+	"for _ = 1, %d do\n"
+	"  local t = now()\n"
+	"  osx.sleep(%d, 'us')\n"
+	"  local over = now() - t - %d * 1000\n"
+	"  total = total + over\n"
+	"  if over > worst then worst = over end\n"
+	"end\n"
+	"return cwd_ns, sleep0_ns, total // %d, worst\n";
+
+static void bench_os(void)
+{
+	char chunk[1024];
+	snprintf(chunk, sizeof(chunk), os_chunk, BENCH_SLEEP_CALLS,
+		 BENCH_SLEEP_US, BENCH_SLEEP_US, BENCH_SLEEP_CALLS);
+	lua_State *L = bench_state();
+	printf("os overheads\n");
+	if (bench_eval(L, chunk, BENCH_CWD_CALLS, 4)) {
+		printf("  os.cwd        %8lld ns/call\n",
+		       (long long)lua_tointeger(L, -4));
+		printf("  os.sleep(0)   %8lld ns/call\n",
+		       (long long)lua_tointeger(L, -3));
+		printf("  os.sleep(%dus) overshoot avg %lld ns, worst %lld ns\n",
+		       BENCH_SLEEP_US, (long long)lua_tointeger(L, -2),
+		       (long long)lua_tointeger(L, -1));
+		lua_pop(L, 4);
+	}
+	lua_close(L);
+}
+
+int main(void)
+{
+	bench_dispatch_modes();
+	bench_latency();
+	bench_throughput();
+	bench_os();
+	return 0;
+}
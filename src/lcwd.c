@@ -3,12 +3,16 @@
 #include <errno.h>
 
 #include "lerror.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #ifdef _WIN32
-#include <direct.h>
-/* MAX_PATH seems to be 260. Seems kind of small. Is there a better one? */
-#define LMAXPATHLEN MAX_PATH
+#include <wchar.h>
+#include <windows.h>
 #else
 #include <unistd.h>
 #ifdef MAXPATHLEN
@@ -19,31 +23,198 @@
 #endif
 #endif
 
-#ifdef _WIN32
-#define _lget_cwd _getcwd
-#define _lchdir _chdir
-#else
+#ifndef _WIN32
 #define _lget_cwd getcwd
 #define _lchdir chdir
 #endif
 
+#ifdef _WIN32
 /*
----#DES 'os.cwd'
----
----This function returns the current working directory.
----Returns nil nil, error desc and errno if unable to get the current directory.
----@return string?, string?, integer?
+** Windows paths go through the wide api and are converted from/to UTF-8.
+** Paths longer than MAX_PATH get the \\?\ prefix, which is stripped again
+** before a path is handed back to lua.
 */
-int eli_cwd(lua_State *L)
+#define LONG_PATH_PREFIX L"\\\\?\\"
+#define LONG_PATH_UNC_PREFIX L"\\\\?\\UNC\\"
+
+static int win_error_to_errno(DWORD err)
 {
-#ifdef NO_GETCWD
-	lua_pushnil(L);
-	lua_pushstring(L, "Function 'getcwd' not provided by system");
-	return 2;
+	switch (err) {
+	case ERROR_FILE_NOT_FOUND:
+	case ERROR_PATH_NOT_FOUND:
+	case ERROR_INVALID_DRIVE:
+		return ENOENT;
+	case ERROR_ACCESS_DENIED:
+	case ERROR_SHARING_VIOLATION:
+		return EACCES;
+	case ERROR_DIRECTORY:
+		return ENOTDIR;
+	case ERROR_FILENAME_EXCED_RANGE:
+		return ENAMETOOLONG;
+	case ERROR_NOT_ENOUGH_MEMORY:
+	case ERROR_OUTOFMEMORY:
+		return ENOMEM;
+	default:
+		return EINVAL;
+	}
+}
+
+/* returns malloc'ed wide copy of UTF-8 str, NULL and errno on failure */
+static wchar_t *utf8_to_wide(const char *str)
+{
+	int len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, str, -1,
+				      NULL, 0);
+	if (len == 0) {
+		errno = EILSEQ;
+		return NULL;
+	}
+	wchar_t *wide = malloc((size_t)len * sizeof(wchar_t));
+	if (wide == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, str, -1, wide, len);
+	return wide;
+}
+
+/* pushes wide path as UTF-8 without long path prefix */
+static int push_wide_path(lua_State *L, const wchar_t *path)
+{
+	int unc = 0;
+	if (wcsncmp(path, LONG_PATH_UNC_PREFIX, 8) == 0) {
+		path += 7; /* \\?\UNC\server -> \\server */
+		unc = 1;
+	} else if (wcsncmp(path, LONG_PATH_PREFIX, 4) == 0) {
+		path += 4;
+	}
+	int len = WideCharToMultiByte(CP_UTF8, 0, path, -1, NULL, 0, NULL,
+				      NULL);
+	if (len == 0) {
+		errno = EILSEQ;
+		return push_error(L, "failed to convert path to UTF-8");
+	}
+	luaL_Buffer b;
+	char *out = luaL_buffinitsize(L, &b, (size_t)len + unc);
+	out[0] = '\\';
+	WideCharToMultiByte(CP_UTF8, 0, path, -1, out + unc, len, NULL, NULL);
+	luaL_pushresultsize(&b, (size_t)len - 1 + unc);
+	return 1;
+}
+
+/*
+** returns malloc'ed absolute wide path, prefixed with \\?\ when it does not
+** fit MAX_PATH, NULL and errno on failure
+*/
+static wchar_t *to_long_path(const char *path)
+{
+	wchar_t *wide = utf8_to_wide(path);
+	if (wide == NULL) {
+		return NULL;
+	}
+	if (wcsncmp(wide, LONG_PATH_PREFIX, 4) == 0) {
+		return wide; /* already prefixed, must not be normalized */
+	}
+	/* query required size (including terminator) up front */
+	DWORD size = GetFullPathNameW(wide, 0, NULL, NULL);
+	if (size == 0) {
+		errno = win_error_to_errno(GetLastError());
+		free(wide);
+		return NULL;
+	}
+	/* leave room for the longest prefix in front */
+	wchar_t *full = malloc(((size_t)size + 8) * sizeof(wchar_t));
+	if (full == NULL) {
+		free(wide);
+		errno = ENOMEM;
+		return NULL;
+	}
+	wchar_t *dst = full + 8;
+	DWORD len = GetFullPathNameW(wide, size, dst, NULL);
+	free(wide);
+	if (len == 0 || len >= size) {
+		errno = len == 0 ? win_error_to_errno(GetLastError()) : EAGAIN;
+		free(full);
+		return NULL;
+	}
+	/* directories are limited to MAX_PATH - 12 (8.3 file name inside) */
+	if (len < MAX_PATH - 12) {
+		memmove(full, dst, ((size_t)len + 1) * sizeof(wchar_t));
+	} else if (dst[0] == L'\\' && dst[1] == L'\\') {
+		/* \\server\share -> \\?\UNC\server\share */
+		memmove(full + 8, dst + 2, ((size_t)len - 1) * sizeof(wchar_t));
+		memcpy(full, LONG_PATH_UNC_PREFIX, 8 * sizeof(wchar_t));
+	} else {
+		memmove(full + 4, dst, ((size_t)len + 1) * sizeof(wchar_t));
+		memcpy(full, LONG_PATH_PREFIX, 4 * sizeof(wchar_t));
+	}
+	return full;
+}
+#endif
+
+#ifndef NO_GETCWD
+/*
+** Last os.cwd result is kept in the registry together with the generation
+** it was read at. Every chdir done through this module bumps the
+** generation, so a warm os.cwd is a registry lookup only. Changes of the
+** working directory done behind our back (other C code) are not seen.
+*/
+// only the address matters, not const so it can never be folded
+static char cwdCacheKey;
+static atomic_uint cwd_generation = 1;
+
+void eli_cwd_invalidate(void)
+{
+	atomic_fetch_add(&cwd_generation, 1);
+}
+
+/* pushes current working directory or returns push_error results */
+static int push_cwd(lua_State *L)
+{
+#ifdef _WIN32
+	wchar_t buffer[MAX_PATH];
+	DWORD len = GetCurrentDirectoryW(MAX_PATH, buffer);
+	if (len == 0) {
+		errno = win_error_to_errno(GetLastError());
+		return push_error(L, "get_dir GetCurrentDirectoryW() failed");
+	}
+	if (len < MAX_PATH) {
+		return push_wide_path(L, buffer);
+	}
+	/* len is the required size including terminator, retry only if the
+	   directory changed in between */
+	while (1) {
+		wchar_t *path = malloc((size_t)len * sizeof(wchar_t));
+		if (path == NULL) {
+			errno = ENOMEM;
+			return push_error(L, "get_dir malloc() failed");
+		}
+		DWORD res = GetCurrentDirectoryW(len, path);
+		if (res == 0) {
+			errno = win_error_to_errno(GetLastError());
+			free(path);
+			return push_error(L, "get_dir GetCurrentDirectoryW() failed");
+		}
+		if (res < len) {
+			int result = push_wide_path(L, path);
+			free(path);
+			return result;
+		}
+		free(path);
+		len = res;
+	}
 #else
+	char buffer[LMAXPATHLEN];
+	if (_lget_cwd(buffer, sizeof(buffer)) != NULL) {
+		lua_pushstring(L, buffer);
+		return 1;
+	}
+	if (errno != ERANGE) {
+		return push_error(L, "get_dir getcwd() failed");
+	}
+
 	char *path = NULL;
 	/* Passing (NULL, 0) is not guaranteed to work. Use a temp buffer and size instead. */
-	size_t size = LMAXPATHLEN; /* initial buffer size */
+	size_t size = LMAXPATHLEN * 2; /* stack buffer was too small already */
 	int result;
 	while (1) {
 		char *path2 = realloc(path, size);
@@ -70,11 +241,83 @@ int eli_cwd(lua_State *L)
 	return result;
 #endif
 }
+#else
+void eli_cwd_invalidate(void)
+{
+}
+#endif
+
+/*
+---#DES 'os.cwd'
+---
+---This function returns the current working directory.
+---Result is cached until the directory is changed through os.chdir.
+---Returns nil nil, error desc and errno if unable to get the current directory.
+---@return string?, string?, integer?
+*/
+int eli_cwd(lua_State *L)
+{
+#ifdef NO_GETCWD
+	lua_pushnil(L);
+	lua_pushstring(L, "Function 'getcwd' not provided by system");
+	return 2;
+#else
+	lua_Integer generation = (lua_Integer)atomic_load(&cwd_generation);
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &cwdCacheKey) == LUA_TTABLE) {
+		lua_rawgeti(L, -1, 2);
+		int hit = lua_tointeger(L, -1) == generation;
+		lua_pop(L, 1);
+		if (hit) {
+			lua_rawgeti(L, -1, 1);
+			lua_remove(L, -2);
+			return 1;
+		}
+	}
+	lua_pop(L, 1);
+
+	int result = push_cwd(L);
+	if (result == 1) {
+		lua_createtable(L, 2, 0);
+		lua_pushvalue(L, -2);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, generation);
+		lua_rawseti(L, -2, 2);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &cwdCacheKey);
+	}
+	return result;
+#endif
+}
+
+/* changes process working directory, returns 0 or -1 and errno */
+static int change_dir(const char *path)
+{
+#ifdef _WIN32
+	wchar_t *wpath = to_long_path(path);
+	if (wpath == NULL) {
+		return -1;
+	}
+	BOOL ok = SetCurrentDirectoryW(wpath);
+	DWORD err = GetLastError();
+	free(wpath);
+	if (!ok) {
+		errno = win_error_to_errno(err);
+		return -1;
+	}
+#else
+	if (_lchdir(path)) {
+		return -1;
+	}
+#endif
+	eli_cwd_invalidate();
+	return 0;
+}
 
 /*
 ---#DES 'os.chdir'
 ---
 ---This function changes the working (current) directory.
+---On windows path is UTF-8, paths over MAX_PATH require long path aware
+---process (see LongPathsEnabled).
 ---Returns true if successful othewise nil, error desc and errno
 ---@param path string
 ---@return boolean?, string?, integer?
@@ -82,10 +325,462 @@ int eli_cwd(lua_State *L)
 int eli_chdir(lua_State *L)
 {
 	const char *path = luaL_checkstring(L, 1);
-	if (_lchdir(path)) {
+	if (change_dir(path)) {
+		return push_error(L, "Unable to change working directory");
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+#ifdef _WIN32
+/* returns malloc'ed wide current directory, NULL and errno on failure */
+static wchar_t *get_cwd_wide(void)
+{
+	DWORD len = GetCurrentDirectoryW(0, NULL);
+	while (len != 0) {
+		wchar_t *path = malloc((size_t)len * sizeof(wchar_t));
+		if (path == NULL) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		DWORD res = GetCurrentDirectoryW(len, path);
+		if (res != 0 && res < len) {
+			return path;
+		}
+		free(path);
+		len = res;
+	}
+	errno = win_error_to_errno(GetLastError());
+	return NULL;
+}
+#endif
+
+/*
+---#DES 'os.with_cwd'
+---
+---Changes working directory to path, calls fn with remaining arguments and
+---changes back even if fn errors. Previous directory is held open (fd) so
+---it is restored even if it was renamed or moved meanwhile. Errors of fn
+---are rethrown after the restore. fn must not yield.
+---Returns results of fn or nil, error desc and errno if unable to change
+---working directory.
+---@param path string
+---@param fn function
+---@return any
+*/
+int eli_with_cwd(lua_State *L)
+{
+	const char *path = luaL_checkstring(L, 1);
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+#ifdef _WIN32
+	wchar_t *saved = get_cwd_wide();
+	if (saved == NULL) {
+		return push_error(L, "Unable to save working directory");
+	}
+#else
+#ifdef O_SEARCH
+	int saved = open(".", O_SEARCH | O_DIRECTORY | O_CLOEXEC);
+#else
+	int saved = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+	if (saved == -1) {
+		return push_error(L, "Unable to save working directory");
+	}
+#endif
+	if (change_dir(path)) {
+		int err = errno;
+#ifdef _WIN32
+		free(saved);
+#else
+		close(saved);
+#endif
+		errno = err;
 		return push_error(L, "Unable to change working directory");
 	}
 
+	int nargs = lua_gettop(L) - 2;
+	int status = lua_pcall(L, nargs, LUA_MULTRET, 0);
+
+#ifdef _WIN32
+	BOOL restored = SetCurrentDirectoryW(saved);
+	free(saved);
+#else
+	int restored = fchdir(saved) == 0;
+	close(saved);
+#endif
+	eli_cwd_invalidate();
+	if (status != LUA_OK) {
+		return lua_error(L);
+	}
+	if (!restored) {
+		return luaL_error(L, "Unable to restore working directory");
+	}
+	return lua_gettop(L) - 1;
+}
+
+/*
+** Per-state working directory. Held in the registry as an open directory
+** fd (handle on windows) together with its resolved path, so relative
+** paths of one state do not depend on chdir done by another thread.
+*/
+#define LOCAL_CWD_METATABLE "ELI_OS_LOCAL_CWD"
+static char localCwdKey;
+
+#ifndef _WIN32
+#if defined(O_PATH)
+#define LOCAL_CWD_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#elif defined(O_SEARCH)
+#define LOCAL_CWD_FLAGS (O_SEARCH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define LOCAL_CWD_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+#endif
+
+typedef struct local_cwd {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	int fd;
+#endif
+} local_cwd;
+
+static void local_cwd_close(local_cwd *cwd)
+{
+#ifdef _WIN32
+	if (cwd->handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(cwd->handle);
+		cwd->handle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (cwd->fd != -1) {
+		close(cwd->fd);
+		cwd->fd = -1;
+	}
+#endif
+}
+
+static int local_cwd_gc(lua_State *L)
+{
+	local_cwd_close(
+		(local_cwd *)luaL_checkudata(L, 1, LOCAL_CWD_METATABLE));
+	return 0;
+}
+
+/* returns local cwd of the state or NULL, anchored in the registry */
+static local_cwd *get_local_cwd(lua_State *L)
+{
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &localCwdKey);
+	local_cwd *cwd = (local_cwd *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return cwd;
+}
+
+/* pushes path of the local cwd or process cwd if not set */
+static int push_local_cwd_path(lua_State *L)
+{
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &localCwdKey) == LUA_TUSERDATA) {
+		lua_getiuservalue(L, -1, 1);
+		lua_remove(L, -2);
+		return 1;
+	}
+	lua_pop(L, 1);
+	return eli_cwd(L);
+}
+
+static int is_absolute_path(const char *path)
+{
+#ifdef _WIN32
+	return path[0] == '\\' || path[0] == '/' ||
+	       (path[0] != '\0' && path[1] == ':');
+#else
+	return path[0] == '/';
+#endif
+}
+
+/* pushes path joined with local cwd unless it is absolute already */
+static int push_local_path(lua_State *L, const char *path)
+{
+	if (is_absolute_path(path)) {
+		lua_pushstring(L, path);
+		return 1;
+	}
+	int res = push_local_cwd_path(L);
+	if (res != 1) {
+		return res;
+	}
+#ifdef _WIN32
+	lua_pushfstring(L, "%s\\%s", lua_tostring(L, -1), path);
+#else
+	lua_pushfstring(L, "%s/%s", lua_tostring(L, -1), path);
+#endif
+	lua_remove(L, -2);
+	return 1;
+}
+
+/*
+---#DES 'os.chdir_local'
+---
+---Changes working directory of the current lua state only. Relative path
+---is resolved against current local working directory. Affects only the
+---*_local functions, process working directory is left untouched.
+---Without path local working directory is dropped (process one is used).
+---Returns true if successful othewise nil, error desc and errno
+---@param path string?
+---@return boolean?, string?, integer?
+*/
+int eli_chdir_local(lua_State *L)
+{
+	const char *path = luaL_optstring(L, 1, NULL);
+	local_cwd *current = get_local_cwd(L);
+	if (path == NULL) {
+		if (current != NULL) {
+			local_cwd_close(current);
+		}
+		lua_pushnil(L);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &localCwdKey);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	int res = push_local_path(L, path);
+	if (res != 1) {
+		return res;
+	}
+	const char *joined = lua_tostring(L, -1);
+#ifdef _WIN32
+	wchar_t *resolved = to_long_path(joined);
+	if (resolved == NULL) {
+		return push_error(L, "Unable to change local working directory");
+	}
+	DWORD attributes = GetFileAttributesW(resolved);
+	if (attributes == INVALID_FILE_ATTRIBUTES ||
+	    !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		errno = attributes == INVALID_FILE_ATTRIBUTES ?
+				win_error_to_errno(GetLastError()) :
+				ENOTDIR;
+		free(resolved);
+		return push_error(L, "Unable to change local working directory");
+	}
+	/* keep the directory open so it can not be removed under us */
+	HANDLE handle = CreateFileW(
+		resolved, FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		errno = win_error_to_errno(GetLastError());
+		free(resolved);
+		return push_error(L, "Unable to change local working directory");
+	}
+	res = push_wide_path(L, resolved);
+	free(resolved);
+	if (res != 1) {
+		CloseHandle(handle);
+		return res;
+	}
+#else
+	// fd is opened from the stored path, so both name the same directory
+	char *resolved = realpath(joined, NULL);
+	if (resolved == NULL) {
+		return push_error(L, "Unable to change local working directory");
+	}
+	int fd = open(resolved, LOCAL_CWD_FLAGS);
+	if (fd == -1) {
+		int err = errno;
+		free(resolved);
+		errno = err;
+		return push_error(L, "Unable to change local working directory");
+	}
+	lua_pushstring(L, resolved);
+	free(resolved);
+#endif
+
+	local_cwd *cwd =
+		(local_cwd *)lua_newuserdatauv(L, sizeof(local_cwd), 1);
+#ifdef _WIN32
+	cwd->handle = handle;
+#else
+	cwd->fd = fd;
+#endif
+	if (luaL_newmetatable(L, LOCAL_CWD_METATABLE)) {
+		lua_pushcfunction(L, local_cwd_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	lua_rotate(L, -2, 1); /* resolved path on top */
+	lua_setiuservalue(L, -2, 1);
+	if (current != NULL) {
+		local_cwd_close(current);
+	}
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &localCwdKey);
+
 	lua_pushboolean(L, 1);
 	return 1;
 }
+
+/*
+---#DES 'os.cwd_local'
+---
+---Returns working directory of the current lua state (see os.chdir_local),
+---process working directory if local one is not set.
+---Returns nil, error desc and errno if unable to get the current directory.
+---@return string?, string?, integer?
+*/
+int eli_cwd_local(lua_State *L)
+{
+	return push_local_cwd_path(L);
+}
+
+static int local_file_close(lua_State *L)
+{
+	luaL_Stream *p = (luaL_Stream *)luaL_checkudata(L, 1, LUA_FILEHANDLE);
+	int res = fclose(p->f);
+	return luaL_fileresult(L, (res == 0), NULL);
+}
+
+/*
+---#DES 'os.open_local'
+---
+---Opens file relative to working directory of the current lua state.
+---Mode is the same as in io.open. Returns file handle compatible with io.
+---Returns nil, error desc and errno if unable to open the file.
+---@param path string
+---@param mode string?
+---@return file*?, string?, integer?
+*/
+int eli_open_local(lua_State *L)
+{
+	const char *path = luaL_checkstring(L, 1);
+	const char *mode = luaL_optstring(L, 2, "r");
+	int flags;
+	switch (mode[0]) {
+	case 'r':
+		flags = 0;
+		break;
+	case 'w':
+		flags = O_CREAT | O_TRUNC;
+		break;
+	case 'a':
+		flags = O_CREAT | O_APPEND;
+		break;
+	default:
+		return luaL_argerror(L, 2, "invalid mode");
+	}
+	const char *rest = mode + 1;
+	int update = *rest == '+';
+	rest += update;
+	luaL_argcheck(L, strspn(rest, "b") == strlen(rest), 2, "invalid mode");
+	flags |= update ? O_RDWR : (mode[0] == 'r' ? O_RDONLY : O_WRONLY);
+
+	luaL_Stream *p =
+		(luaL_Stream *)lua_newuserdatauv(L, sizeof(luaL_Stream), 0);
+	p->closef = NULL; /* mark file handle as 'closed' */
+	luaL_setmetatable(L, LUA_FILEHANDLE);
+#ifdef _WIN32
+	(void)flags;
+	int res = push_local_path(L, path);
+	if (res != 1) {
+		return res;
+	}
+	wchar_t *wpath = to_long_path(lua_tostring(L, -1));
+	lua_pop(L, 1);
+	if (wpath == NULL) {
+		return push_error(L, "Unable to open file");
+	}
+	wchar_t wmode[8] = { 0 };
+	for (size_t i = 0; i < 7 && mode[i] != '\0'; i++) {
+		wmode[i] = (wchar_t)mode[i];
+	}
+	p->f = _wfopen(wpath, wmode);
+	int err = errno;
+	free(wpath);
+	if (p->f == NULL) {
+		errno = err;
+		return push_error(L, "Unable to open file");
+	}
+#else
+	local_cwd *cwd = get_local_cwd(L);
+	int fd = openat(cwd != NULL ? cwd->fd : AT_FDCWD, path,
+			flags | O_CLOEXEC, 0666);
+	if (fd == -1) {
+		return push_error(L, "Unable to open file");
+	}
+	p->f = fdopen(fd, mode);
+	if (p->f == NULL) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return push_error(L, "Unable to open file");
+	}
+#endif
+	p->closef = &local_file_close;
+	return 1;
+}
+
+/*
+---#DES 'os.stat_local'
+---
+---Returns file info of path relative to working directory of the current
+---lua state. Symlinks are followed unless `nofollow` is set.
+---Returns nil, error desc and errno if unable to stat the path.
+---@param path string
+---@param nofollow boolean?
+---@return { type: '"file"' | '"directory"' | '"link"' | '"other"', size: integer, mode: integer, mtime: integer }?, string?, integer?
+*/
+int eli_stat_local(lua_State *L)
+{
+	const char *path = luaL_checkstring(L, 1);
+	const char *type;
+#ifdef _WIN32
+	struct _stat64 st;
+	int res = push_local_path(L, path);
+	if (res != 1) {
+		return res;
+	}
+	wchar_t *wpath = to_long_path(lua_tostring(L, -1));
+	lua_pop(L, 1);
+	if (wpath == NULL) {
+		return push_error(L, "Unable to stat path");
+	}
+	res = _wstat64(wpath, &st);
+	int err = errno;
+	free(wpath);
+	if (res != 0) {
+		errno = err;
+		return push_error(L, "Unable to stat path");
+	}
+	if (st.st_mode & _S_IFDIR) {
+		type = "directory";
+	} else if (st.st_mode & _S_IFREG) {
+		type = "file";
+	} else {
+		type = "other";
+	}
+#else
+	struct stat st;
+	local_cwd *cwd = get_local_cwd(L);
+	if (fstatat(cwd != NULL ? cwd->fd : AT_FDCWD, path, &st,
+		    lua_toboolean(L, 2) ? AT_SYMLINK_NOFOLLOW : 0) != 0) {
+		return push_error(L, "Unable to stat path");
+	}
+	if (S_ISDIR(st.st_mode)) {
+		type = "directory";
+	} else if (S_ISREG(st.st_mode)) {
+		type = "file";
+	} else if (S_ISLNK(st.st_mode)) {
+		type = "link";
+	} else {
+		type = "other";
+	}
+#endif
+	lua_createtable(L, 0, 4);
+	lua_pushstring(L, type);
+	lua_setfield(L, -2, "type");
+	lua_pushinteger(L, (lua_Integer)st.st_size);
+	lua_setfield(L, -2, "size");
+	lua_pushinteger(L, (lua_Integer)(st.st_mode & 07777));
+	lua_setfield(L, -2, "mode");
+	lua_pushinteger(L, (lua_Integer)st.st_mtime);
+	lua_setfield(L, -2, "mtime");
+	return 1;
+}
@@ -5,5 +5,11 @@
 
 int eli_cwd(lua_State *L);
 int eli_chdir(lua_State *L);
+int eli_with_cwd(lua_State *L);
+void eli_cwd_invalidate(void);
+int eli_chdir_local(lua_State *L);
+int eli_cwd_local(lua_State *L);
+int eli_open_local(lua_State *L);
+int eli_stat_local(lua_State *L);
 
 #endif /* LUA_OS_EXTRA_CWD_H__ */
\ No newline at end of file
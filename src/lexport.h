@@ -0,0 +1,13 @@
+#ifndef LUA_OS_EXTRA_EXPORT_H
+#define LUA_OS_EXTRA_EXPORT_H
+
+// luaopen_* entry points stay visible when built with -fvisibility=hidden
+#if defined(_WIN32) && defined(ELI_OS_EXTRA_SHARED_LIBRARY)
+#define ELI_OS_EXTRA_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define ELI_OS_EXTRA_API __attribute__((visibility("default")))
+#else
+#define ELI_OS_EXTRA_API
+#endif
+
+#endif /* LUA_OS_EXTRA_EXPORT_H */
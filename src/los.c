@@ -3,7 +3,10 @@
 
 #include <string.h>
 #include "lcwd.h"
-#include "lsleep.h"
+#include "lerror.h"
+#include "los_signal.h"
+#include "ltime.h"
+#include "ltimer.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -11,32 +14,109 @@
 #include <unistd.h>
 #endif
 
+#ifndef ELI_OS_EXTRA_NO_SLEEP
 /*
 ---#DES 'os.sleep'
 ---
----Sleep duration seconds (default) or less if divider/unit specified
----@param duration integer
----@param unit_or_divider '"s"' | '"ms"' | integer | nil
-
+---Sleep duration seconds (default) or less if divider/unit specified.
+---Fractional durations are supported, precision goes down to nanoseconds
+---where the platform allows it.
+---With `interruptible` set, sleep ends early once a signal handled through
+---os.signal is queued and returns remaining duration (in the same unit)
+---and signum which woke it; remaining is 0 if the whole duration elapsed.
+---Otherwise (or when built without os.signal) returns true.
+---Returns nil, error desc and errno on failure.
+---@param duration number
+---@param unit_or_divider '"s"' | '"ms"' | '"us"' | '"ns"' | integer | nil
+---@param interruptible boolean?
+---@return boolean|number?, string|integer?, integer?
 */
 static int eli_sleep(lua_State *L)
 {
-	int duration = (int)luaL_checknumber(L, 1);
-	sleep_ms(sleep_duration_to_ms(duration,
-				      get_sleep_divider_from_state(L, 2, 1)));
-	return 0;
+	int64_t ns = eli_check_duration_ns(L, 1, 2);
+#ifndef ELI_OS_EXTRA_NO_SIGNAL
+	if (lua_toboolean(L, 3)) {
+		lua_Number divider = eli_check_duration_divider(L, 2);
+		int signum;
+		int64_t remaining = eli_signal_sleep_ns(L, ns, &signum);
+		if (remaining < 0) {
+			return push_error(L, "sleep failed");
+		}
+		lua_pushnumber(L, (lua_Number)remaining * divider / 1e9);
+		if (signum == 0) {
+			return 1;
+		}
+		lua_pushinteger(L, signum);
+		return 2;
+	}
+#endif
+	if (eli_sleep_ns(ns) != 0) {
+		return push_error(L, "sleep failed");
+	}
+	lua_pushboolean(L, 1);
+	return 1;
 }
 
+/*
+---#DES 'os.sleep_until'
+---
+---Sleeps until monotonic clock (see `os.monotonic_ns`) reaches deadline.
+---Use for fixed rate loops - adding interval to previous deadline does not
+---accumulate drift.
+---Returns true on success, otherwise nil, error desc and errno.
+---@param deadline integer - ns
+---@return boolean?, string?, integer?
+*/
+static int eli_sleep_until(lua_State *L)
+{
+	int64_t deadline = (int64_t)luaL_checkinteger(L, 1);
+	if (eli_sleep_until_ns(deadline) != 0) {
+		return push_error(L, "sleep failed");
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+---#DES 'os.monotonic_ns'
+---
+---Returns monotonic clock reading in nanoseconds. The epoch is unspecified,
+---only differences are meaningful.
+---@return integer
+*/
+static int eli_monotonic(lua_State *L)
+{
+	lua_pushinteger(L, (lua_Integer)eli_monotonic_ns());
+	return 1;
+}
+#endif
+
 static const struct luaL_Reg eliOsExtra[] = {
+#ifndef ELI_OS_EXTRA_NO_SLEEP
 	{ "sleep", eli_sleep },
+	{ "sleep_until", eli_sleep_until },
+	{ "monotonic_ns", eli_monotonic },
+	{ "timer", eli_timer },
+#endif
+#ifndef ELI_OS_EXTRA_NO_CWD
 	{ "chdir", eli_chdir },
 	{ "cwd", eli_cwd },
+	{ "with_cwd", eli_with_cwd },
+	{ "chdir_local", eli_chdir_local },
+	{ "cwd_local", eli_cwd_local },
+	{ "open_local", eli_open_local },
+	{ "stat_local", eli_stat_local },
+#endif
 	{ NULL, NULL },
 };
 
-int luaopen_eli_os_extra(lua_State *L)
+ELI_OS_EXTRA_API int luaopen_eli_os_extra(lua_State *L)
 {
-	lua_newtable(L);
+#ifndef ELI_OS_EXTRA_NO_SLEEP
+	eli_timer_create_meta(L);
+#endif
+	lua_createtable(L, 0,
+			(int)(sizeof(eliOsExtra) / sizeof(eliOsExtra[0]) - 1));
 	luaL_setfuncs(L, eliOsExtra, 0);
 	return 1;
 }
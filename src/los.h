@@ -2,7 +2,8 @@
 #define LUA_OS_EXTRA_H
 
 #include "lua.h"
+#include "lexport.h"
 
-int luaopen_eli_os_extra(lua_State *L);
+ELI_OS_EXTRA_API int luaopen_eli_os_extra(lua_State *L);
 
 #endif // LUA_OS_EXTRA_H
\ No newline at end of file
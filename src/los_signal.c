@@ -1,37 +1,312 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* ppoll */
+#endif
+
 #include "lauxlib.h"
 #include "lua.h"
 
+#include <errno.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
 #include "lcwd.h"
 #include "lerror.h"
+#include "los_signal.h"
+#include "ltime.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#endif
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include <limits.h>
+#include <stdlib.h>
+
+#if defined(_WIN32) && !defined(SIGCHLD)
+// pseudo signal carrying signal.watch_child exits, never raised by the os
+#define SIGCHLD 20
+#define ELI_PSEUDO_SIGCHLD
+#endif
+#ifndef CLD_EXITED
+#define CLD_EXITED 1
+#endif
+
+// signal.watch_child backends: pidfd + watcher thread, process handle wait
+#if defined(__linux__) && defined(LUA_USE_POSIX)
+#define ELI_CHILD_WATCH_PIDFD
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#elif defined(_WIN32)
+#define ELI_CHILD_WATCH_HANDLE
+#endif
 
 #ifdef _WIN32
-CRITICAL_SECTION SignalCriticalSection;
 static int subscribedCtrlEvents = 0;
+// signal.wait() state, signals in the mask are consumed by the waiter
+static HANDLE signal_wait_event = NULL;
+static volatile LONG signal_wait_mask = 0;
+static volatile LONG signal_wait_signum = 0;
+// close/logoff/shutdown wait until their handlers finished (ctrl_done_event)
+static HANDLE ctrl_done_event = NULL;
+static volatile LONG ctrl_pending = 0;
+#define CTRL_PENDING_UNKNOWN 0x10000
+#endif
+
+/*
+** Console control event kinds passed to handlers as second argument,
+** 0 (passed as false) for signals not originating from a console event.
+*/
+enum signal_ctrl_kind {
+	SIGNAL_CTRL_NONE = 0,
+	SIGNAL_CTRL_C = 1,
+	SIGNAL_CTRL_BREAK = 2,
+	SIGNAL_CTRL_CLOSE = 3,
+	SIGNAL_CTRL_LOGOFF = 4,
+	SIGNAL_CTRL_SHUTDOWN = 5,
+};
+// ms console handler waits for close/logoff/shutdown handlers
+static atomic_int ctrl_budget_ms = 4500;
+
+// capacity of the signal queue, configurable at build time (power of two)
+#ifndef ELI_SIGNAL_QUEUE_SIZE
+#define ELI_SIGNAL_QUEUE_SIZE 64
+#endif
+#if ELI_SIGNAL_QUEUE_SIZE < 2 || \
+	(ELI_SIGNAL_QUEUE_SIZE & (ELI_SIGNAL_QUEUE_SIZE - 1)) != 0
+#error "ELI_SIGNAL_QUEUE_SIZE must be a power of two"
+#endif
+#define SIGNAL_QUEUE_MASK (ELI_SIGNAL_QUEUE_SIZE - 1)
+
+// maximum number of lua states with os.signal opened at the same time
+#ifndef ELI_SIGNAL_MAX_STATES
+#define ELI_SIGNAL_MAX_STATES 16
 #endif
 
-#define SIGNAL_QUEUE_MAX 25
-static volatile sig_atomic_t signal_pending = 0, defer_signal = 0,
-			     processing_signals = 0;
-static volatile sig_atomic_t signal_count = 0;
+#ifdef NSIG
+#define ELI_SIGNAL_MAX NSIG
+#else
+#define ELI_SIGNAL_MAX 65
+#endif
+#define SIGNAL_MASK_WORDS ((ELI_SIGNAL_MAX + 31) / 32)
+
+// sigaction flags/mask requested by signal.handle options
+enum {
+	SIGNAL_OPT_RESTART = 1 << 0,
+	SIGNAL_OPT_NODEFER = 1 << 1,
+	SIGNAL_OPT_RESETHAND = 1 << 2,
+	SIGNAL_OPT_ONSTACK = 1 << 3,
+};
+
+typedef struct signal_options {
+	int flags;
+	unsigned int mask[SIGNAL_MASK_WORDS]; // signals blocked in handler
+} signal_options;
+
+// payload of SA_SIGINFO deliveries
+typedef struct signal_info {
+	int pid;
+	unsigned int uid;
+	int code;
+	int status;
+	int value;
+} signal_info;
+
+typedef struct signal_event {
+	int signum;
+	int ctrl_event;
+	int has_info;
+	signal_info info;
+	int64_t time; // monotonic ns of arrival
+} signal_event;
+
+/*
+** Per signal counters of signal.stats(). Producer side counters are
+** atomics bumped from signal handlers, consumer side ones (dispatched,
+** errors, latency) are only touched by the lua state itself.
+*/
+typedef struct signal_counters {
+	atomic_uint received;
+	atomic_uint dropped; // queue was full
+	atomic_uint coalesced; // merged into already pending occurrence
+	lua_Integer dispatched;
+	lua_Integer errors; // handlers or awaiting coroutines which raised
+	int64_t latency_ns; // sum of arrival to last handler return
+} signal_counters;
+
+/*
+** Bounded lock-free queue of delivered signals. Producers are signal
+** handlers (which may nest and run on any thread) and, on windows, the
+** console control thread; the only consumer is the lua state owning the
+** queue. Each slot carries a sequence number which tells whether it is
+** free for the producer at position `pos` (seq == pos) or ready for the
+** consumer (seq == pos + 1), so neither side ever takes a lock.
+*/
+typedef struct signal_entry {
+	atomic_uint seq;
+	signal_event event;
+} signal_entry;
+
+typedef struct signal_ring {
+	signal_entry entries[ELI_SIGNAL_QUEUE_SIZE];
+	atomic_uint head; // next slot to consume
+	atomic_uint tail; // next slot to produce
+} signal_ring;
+
+// fields of handler list entries, lists are sorted by priority (desc)
+enum {
+	SIGNAL_HANDLER_FN = 1,
+	SIGNAL_HANDLER_PRIORITY = 2,
+};
+
+// how queued signals get dispatched to lua handlers
+enum {
+	SIGNAL_DISPATCH_HOOK = 0, // hook on next instruction (default)
+	SIGNAL_DISPATCH_COUNT, // count hook only, fires after N instructions
+	SIGNAL_DISPATCH_POLL, // no hook, lua calls signal.dispatch()
+};
+
+/*
+** Per lua state subscription. Every state which opens os.signal gets its
+** own queue, handlers, dispatch mode and wakeup object. Signal handlers fan
+** delivered signals out to all states subscribed to the signum.
+*/
+typedef struct signal_state {
+	lua_State *L; // main thread of the subscribed state
+	int slot; // index in signal_states, -1 if not registered
+	int handlersRef;
+	// dispatch view of handlersRef kept in sync on every change: registry
+	// ref of the handler function or, with more handlers, of a plain array
+	// of them in priority order; LUA_NOREF if signal has no handler
+	int handlerRefs[ELI_SIGNAL_MAX];
+	// read-only view returned by signal.handlers(), valid while its
+	// version matches handlers_version (bumped on every handler change)
+	unsigned int handlers_version;
+	unsigned int handlers_view_version;
+	int handlersViewRef;
+	// info table reused for every siginfo delivery of signum
+	int infoRefs[ELI_SIGNAL_MAX];
+	// coroutines parked by signal.await: signum -> array of threads, and
+	// array of {co, signum, ctrl_event, count_or_info} woken by delivery
+	// but not yet resumed by signal.dispatch
+	int waitersRef;
+	int readyRef;
+	int waiting[ELI_SIGNAL_MAX];
+
+	volatile sig_atomic_t handled[ELI_SIGNAL_MAX];
+	volatile sig_atomic_t siginfo[ELI_SIGNAL_MAX];
+
+	// signals marked `urgent` go to their own ring which is always
+	// drained first, so they never wait behind a backlog of others
+	signal_ring queue;
+	signal_ring urgent_queue;
+	volatile sig_atomic_t urgent[ELI_SIGNAL_MAX];
+	atomic_uint dropped; // signals lost because queue was full
+
+	// signals handled in coalescing mode are not queued, instead each
+	// signum accumulates an occurrence count (non zero = pending) and a
+	// bit in coalesced_mask so the drain only visits signals which fired
+	volatile sig_atomic_t coalesce[ELI_SIGNAL_MAX];
+	atomic_uint coalesced_count[ELI_SIGNAL_MAX];
+	atomic_int coalesced_ctrl[ELI_SIGNAL_MAX];
+	atomic_llong coalesced_time[ELI_SIGNAL_MAX]; // first pending occurrence
+	atomic_uint coalesced_mask[SIGNAL_MASK_WORDS];
 
-static volatile sig_atomic_t signals[SIGNAL_QUEUE_MAX];
+	signal_counters stats[ELI_SIGNAL_MAX];
+	atomic_uint max_depth; // most events observed in a queue at once
+
+	volatile sig_atomic_t dispatch_mode;
+	volatile sig_atomic_t dispatch_hook_mask;
+	volatile sig_atomic_t dispatch_hook_count;
+	volatile sig_atomic_t last_signum; // reported by interrupted sleeps
+	// signal.block nesting, while non zero signals are queued but the
+	// hook is not armed; with `mask` they are also blocked in the kernel
+	// from level defer_mask_depth on
+	volatile sig_atomic_t defer_depth;
+	int defer_mask_depth;
+#ifdef LUA_USE_POSIX
+	sigset_t defer_old_mask;
+	// thread which opened os.signal, the only one touching hooks of L;
+	// producers on other threads set arm_requested and kick it instead
+	pthread_t owner;
+	atomic_int arm_requested;
+#endif
+
+	// wakeup object signalled on every queued signal, see signal.fd()
 #ifdef _WIN32
-static volatile sig_atomic_t signalKinds[SIGNAL_QUEUE_MAX];
+	HANDLE event;
+#else
+	volatile sig_atomic_t wakeup_read_fd, wakeup_write_fd;
 #endif
+} signal_state;
 
-static lua_State *mainL = NULL;
-static int handlersRef = LUA_NOREF;
+#define SIGNAL_STATE_METATABLE "ELI_OS_SIGNAL_STATE"
+static char signalStateKey;
+
+static _Atomic(signal_state *) signal_states[ELI_SIGNAL_MAX_STATES];
+static _Atomic(signal_state *) primary_state; // interrupted by default SIGINT
+static atomic_int signal_states_busy; // signal handlers currently fanning out
+
+#ifdef LUA_USE_POSIX
+/*
+** lua_sethook must not be called on a state running in another thread.
+** Threads which are not the owner (dispatcher, child watcher, any thread
+** the kernel delivers a signal to) queue the event, signal the wakeup object
+** and kick the owner with ELI_SIGNAL_KICK, whose handler arms the hook in
+** the owning thread. SIGURG is ignored by default, so stray kicks are
+** harmless.
+*/
+#ifndef ELI_SIGNAL_KICK
+#define ELI_SIGNAL_KICK SIGURG
+#endif
+static int signal_kick_installed = 0; // guarded by registry lock
+#endif
+
+// handle/reset from several threads, guards subscriber counts and
+// process wide dispositions (never taken inside signal handlers)
+static atomic_flag signal_registry_lock = ATOMIC_FLAG_INIT;
+static int signal_subscribers[ELI_SIGNAL_MAX];
+// process wide, last signal.handle of signum wins
+static volatile sig_atomic_t signal_resethand[ELI_SIGNAL_MAX];
+
+#define get_signal_state(L) \
+	((signal_state *)lua_touserdata(L, lua_upvalueindex(1)))
 
 static void call_lua_callback(lua_State *L, lua_Debug *ar);
-static void trigger_lua_callback(lua_State *L, int signum, int ctrl_event);
+static int trigger_lua_callback(int signum, int ctrl_event);
+static int trigger_signal_event(const signal_event *event);
+static int child_watch_release(signal_state *st, lua_Integer pid, int all);
+#ifdef LUA_USE_POSIX
+static void signal_arm_requested(void);
+static void signal_kick_handler(int signum);
+#endif
+
+static void signal_registry_acquire(void)
+{
+	while (atomic_flag_test_and_set_explicit(&signal_registry_lock,
+						 memory_order_acquire)) {
+	}
+}
+
+static void signal_registry_release(void)
+{
+	atomic_flag_clear_explicit(&signal_registry_lock, memory_order_release);
+}
 
 #ifdef _WIN32
 
@@ -49,35 +324,151 @@ int signal_to_ctrl_event(int signum)
 	}
 }
 
-BOOL WINAPI windows_ctrl_handler(DWORD signum)
+// called once dispatched event of ctrl kind finished its handlers
+static void signal_ctrl_done(int kind)
+{
+	if (kind < SIGNAL_CTRL_CLOSE) {
+		return;
+	}
+	LONG pending = ctrl_pending;
+	while (pending > 0) {
+		LONG prev = InterlockedCompareExchange(&ctrl_pending,
+						       pending - 1, pending);
+		if (prev == pending) {
+			if (pending == 1) {
+				SetEvent(ctrl_done_event);
+			}
+			return;
+		}
+		pending = prev;
+	}
+}
+
+BOOL WINAPI windows_ctrl_handler(DWORD ctrl)
 {
 	// convert windows signals to posix signals
-	switch (signum) {
+	int signum, kind;
+	switch (ctrl) {
 	case CTRL_C_EVENT:
 		signum = SIGINT;
+		kind = SIGNAL_CTRL_C;
 		break;
 	case CTRL_BREAK_EVENT:
 		signum = SIGBREAK;
+		kind = SIGNAL_CTRL_BREAK;
 		break;
 	case CTRL_CLOSE_EVENT:
 		signum = SIGTERM;
+		kind = SIGNAL_CTRL_CLOSE;
 		break;
 	case CTRL_LOGOFF_EVENT:
 		signum = SIGTERM;
+		kind = SIGNAL_CTRL_LOGOFF;
 		break;
 	case CTRL_SHUTDOWN_EVENT:
 		signum = SIGTERM;
+		kind = SIGNAL_CTRL_SHUTDOWN;
 		break;
+	default:
+		return FALSE;
+	}
+	if (signal_wait_mask & (1L << signum)) {
+		InterlockedExchange(&signal_wait_signum, (LONG)signum);
+		SetEvent(signal_wait_event);
+		return TRUE;
+	}
+	int budget = atomic_load(&ctrl_budget_ms);
+	if (kind < SIGNAL_CTRL_CLOSE || budget <= 0 ||
+	    ctrl_done_event == NULL) {
+		trigger_lua_callback(signum, kind);
+		return TRUE; // Indicate that the handler handled the event.
+	}
+	// the process is terminated as soon as we return, so wait for the
+	// states the event was queued to; the number is known only after
+	// queuing, until then pending is biased by CTRL_PENDING_UNKNOWN
+	ResetEvent(ctrl_done_event);
+	InterlockedExchange(&ctrl_pending, CTRL_PENDING_UNKNOWN);
+	int queued = trigger_lua_callback(signum, kind);
+	LONG adjust = queued - CTRL_PENDING_UNKNOWN;
+	if (InterlockedExchangeAdd(&ctrl_pending, adjust) + adjust > 0) {
+		WaitForSingleObject(ctrl_done_event, (DWORD)budget);
+	}
+	InterlockedExchange(&ctrl_pending, 0);
+	return TRUE;
+}
+
+// installs or removes console handler to match subscribed signals,
+// called with registry lock held
+static int update_ctrl_handler(void)
+{
+	static const int ctrl_signals[] = { SIGINT, SIGBREAK, SIGTERM };
+	int events = 0;
+	for (size_t i = 0; i < sizeof(ctrl_signals) / sizeof(ctrl_signals[0]);
+	     i++) {
+		if (signal_subscribers[ctrl_signals[i]] > 0) {
+			events |= 1 << signal_to_ctrl_event(ctrl_signals[i]);
+		}
+	}
+	if (events != 0 && ctrl_done_event == NULL) {
+		ctrl_done_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (ctrl_done_event == NULL) {
+			return -1;
+		}
 	}
-	trigger_lua_callback(mainL, signum, 1);
-	return TRUE; // Indicate that the handler handled the event.
+	if (events != 0 && subscribedCtrlEvents == 0) {
+		if (!SetConsoleCtrlHandler(windows_ctrl_handler, TRUE)) {
+			return -1;
+		}
+	} else if (events == 0 && subscribedCtrlEvents != 0) {
+		if (!SetConsoleCtrlHandler(windows_ctrl_handler, FALSE)) {
+			return -1;
+		}
+	}
+	subscribedCtrlEvents = events;
+	return 0;
 }
 #endif
 
 void standard_signal_handler(int signum)
 {
-	trigger_lua_callback(mainL, signum, 0);
+#if !defined(LUA_USE_POSIX)
+	// plain signal() resets disposition on delivery, keep it installed
+	// unless `resethand` was requested
+	if (signum > 0 && signum < ELI_SIGNAL_MAX &&
+	    !signal_resethand[signum]) {
+		signal(signum, standard_signal_handler);
+	}
+#endif
+	trigger_lua_callback(signum, 0);
+}
+
+#ifndef _WIN32
+static void signal_info_from_siginfo(signal_info *dst, const siginfo_t *info)
+{
+	dst->pid = (int)info->si_pid;
+	dst->uid = (unsigned int)info->si_uid;
+	dst->code = info->si_code;
+	dst->status = info->si_status;
+	dst->value = info->si_value.sival_int;
+}
+#endif
+
+#ifdef LUA_USE_POSIX
+void siginfo_signal_handler(int signum, siginfo_t *info, void *context)
+{
+	(void)context;
+	signal_event event;
+	event.signum = signum;
+	event.ctrl_event = 0;
+	event.has_info = info != NULL;
+	if (info != NULL) {
+		signal_info_from_siginfo(&event.info, info);
+	}
+	trigger_signal_event(&event);
+	// the signal might have landed in a thread owning a kicked state
+	signal_arm_requested();
 }
+#endif
 
 /*
 ** Hook set by signal function to stop the interpreter.
@@ -97,231 +488,3354 @@ static void lua_interrupt(lua_State *L, lua_Debug *ar)
 */
 static void default_lua_sigint_handler(int i)
 {
-	int flag = LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT;
 	signal(i, SIG_DFL); /* if another SIGINT happens, terminate process */
-	lua_sethook(mainL, lua_interrupt, flag, 1);
+	signal_state *st = atomic_load(&primary_state);
+	if (st == NULL) {
+		raise(i); /* nothing to interrupt */
+		return;
+	}
+	// there is nobody to poll for interruption, so always count hook
+	lua_sethook(st->L, lua_interrupt,
+		    st->dispatch_mode == SIGNAL_DISPATCH_HOOK ?
+			    st->dispatch_hook_mask :
+			    LUA_MASKCOUNT,
+		    st->dispatch_mode == SIGNAL_DISPATCH_POLL ?
+			    1 :
+			    st->dispatch_hook_count);
 }
 
-static void call_lua_callback(lua_State *L, lua_Debug *ar)
+static void signal_queue_init(signal_ring *ring)
 {
-	(void)ar; /* unused arg. */
-	lua_sethook(L, NULL, 0, 0); /* reset hook */
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	for (unsigned int i = 0; i < ELI_SIGNAL_QUEUE_SIZE; i++) {
+		atomic_init(&ring->entries[i].seq, i);
+	}
+}
 
-// copy signals to cleanup queue and allow new signals to be queued
-#ifdef _WIN32
-	EnterCriticalSection(&SignalCriticalSection);
-#endif
-	processing_signals = 1;
-	sig_atomic_t count = signal_count;
-	sig_atomic_t queued[SIGNAL_QUEUE_MAX];
-	memcpy(queued, (const void *)signals, sizeof(sig_atomic_t) * count);
-#ifdef _WIN32
-	sig_atomic_t queuedKinds[SIGNAL_QUEUE_MAX];
-	memcpy(queuedKinds, (const void *)signalKinds,
-	       sizeof(sig_atomic_t) * count);
-#endif
-	signal_count = 0;
-	processing_signals = 0;
-#ifdef _WIN32
-	LeaveCriticalSection(&SignalCriticalSection);
-#endif
+// async-signal-safe, returns 0 if the queue is full
+static int signal_queue_push(signal_state *st, signal_ring *ring,
+			     const signal_event *event)
+{
+	unsigned int pos =
+		atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	signal_entry *slot;
+	for (;;) {
+		slot = &ring->entries[pos & SIGNAL_QUEUE_MASK];
+		unsigned int seq =
+			atomic_load_explicit(&slot->seq, memory_order_acquire);
+		int diff = (int)(seq - pos);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				    &ring->tail, &pos, pos + 1,
+				    memory_order_relaxed,
+				    memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&st->dropped, 1,
+						  memory_order_relaxed);
+			atomic_fetch_add_explicit(
+				&st->stats[event->signum].dropped, 1,
+				memory_order_relaxed);
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&ring->tail,
+						   memory_order_relaxed);
+		}
+	}
+	slot->event = *event;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
 
-	lua_rawgeti(L, LUA_REGISTRYINDEX, handlersRef);
+	unsigned int depth =
+		pos + 1 - atomic_load_explicit(&ring->head, memory_order_relaxed);
+	unsigned int max =
+		atomic_load_explicit(&st->max_depth, memory_order_relaxed);
+	while (depth > max && !atomic_compare_exchange_weak_explicit(
+				      &st->max_depth, &max, depth,
+				      memory_order_relaxed,
+				      memory_order_relaxed)) {
+	}
+	return 1;
+}
 
-	while (count--) {
-		int signum = queued[count];
-		lua_rawgeti(L, -1, signum);
-		if (lua_isnil(L, -1)) {
-			lua_pop(L, 1);
-			continue;
-		}
-		lua_pushinteger(L, signum);
-#ifdef _WIN32
-		lua_pushboolean(L, queuedKinds[count]);
-#else
-		lua_pushboolean(L, 0);
-#endif
-		if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
-			lua_writestringerror(
-				"error calling signal handler: %s\n",
-				lua_tostring(L, -1));
+// consumer side, returns 0 if there is no (fully published) entry
+static int signal_queue_pop(signal_ring *ring, signal_event *event)
+{
+	unsigned int pos =
+		atomic_load_explicit(&ring->head, memory_order_relaxed);
+	signal_entry *slot = &ring->entries[pos & SIGNAL_QUEUE_MASK];
+	unsigned int seq =
+		atomic_load_explicit(&slot->seq, memory_order_acquire);
+	if ((int)(seq - (pos + 1)) < 0) {
+		return 0;
+	}
+	*event = slot->event;
+	atomic_store_explicit(&slot->seq, pos + ELI_SIGNAL_QUEUE_SIZE,
+			      memory_order_release);
+	atomic_store_explicit(&ring->head, pos + 1, memory_order_relaxed);
+	return 1;
+}
+
+// pops next event in arrival order, urgent ones first
+static int signal_next_event(signal_state *st, signal_event *event)
+{
+	return signal_queue_pop(&st->urgent_queue, event) ||
+	       signal_queue_pop(&st->queue, event);
+}
+
+static void arm_lua_callback(signal_state *st)
+{
+	if (st->dispatch_mode == SIGNAL_DISPATCH_POLL || st->defer_depth > 0) {
+		return;
+	}
+	// re-arming would restart the count, so frequent signals in "count"
+	// mode could postpone dispatch until the queue overflows
+	if (lua_gethook(st->L) == call_lua_callback) {
+		return;
+	}
+	lua_sethook(st->L, call_lua_callback, st->dispatch_hook_mask,
+		    st->dispatch_hook_count);
+}
+
+#ifdef LUA_USE_POSIX
+// async-signal-safe, arms hooks requested by other threads for states
+// owned by the calling thread
+static void signal_arm_requested(void)
+{
+	int saved_errno = errno;
+	pthread_t self = pthread_self();
+	atomic_fetch_add(&signal_states_busy, 1);
+	for (int i = 0; i < ELI_SIGNAL_MAX_STATES; i++) {
+		signal_state *st = atomic_load(&signal_states[i]);
+		if (st != NULL && pthread_equal(st->owner, self) &&
+		    atomic_exchange(&st->arm_requested, 0)) {
+			arm_lua_callback(st);
 		}
 	}
+	atomic_fetch_sub(&signal_states_busy, 1);
+	errno = saved_errno;
 }
 
-// inspired by https://github.com/luaposix/luaposix/blob/aa2c8bf5af2eef5dd1e3de5f6ca55b90427c1b58/ext/posix/signal.c#L158
-// and lua.c#70 (laction)
-static void trigger_lua_callback(lua_State *L, int signum, int ctrl_event)
+static void signal_kick_handler(int signum)
 {
-	if (defer_signal || processing_signals) {
-		signal_pending = signum;
+	(void)signum;
+	signal_arm_requested();
+}
+
+// installs kick handler unless the kick signal is owned by someone else,
+// called with registry lock held
+static void signal_kick_install(void)
+{
+	if (signal_kick_installed) {
 		return;
 	}
-	if (signal_count == SIGNAL_QUEUE_MAX) {
+	struct sigaction current;
+	if (sigaction(ELI_SIGNAL_KICK, NULL, &current) == -1) {
 		return;
 	}
-#ifdef _WIN32
-	EnterCriticalSection(&SignalCriticalSection);
-#endif
-	defer_signal++;
-	signals[signal_count] = signum;
-#ifdef _WIN32
-	signalKinds[signal_count] = ctrl_event;
-#endif
-	signal_count++;
-	lua_sethook(mainL, call_lua_callback,
-		    LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT,
-		    1);
-	defer_signal--;
-#ifdef _WIN32
-	LeaveCriticalSection(&SignalCriticalSection);
+	if (current.sa_flags & SA_SIGINFO) {
+		// handled through os.signal, its handler serves kicks too
+		if (current.sa_sigaction != siginfo_signal_handler) {
+			return;
+		}
+	} else if (current.sa_handler != SIG_DFL &&
+		   current.sa_handler != SIG_IGN) {
+		return;
+	} else {
+		struct sigaction sa;
+		sa.sa_handler = signal_kick_handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(ELI_SIGNAL_KICK, &sa, NULL) == -1) {
+			return;
+		}
+	}
+	signal_kick_installed = 1;
+}
 #endif
-	if (defer_signal == 0 && signal_pending != 0) {
-		raise(signal_pending);
+
+static void disarm_lua_callback(signal_state *st)
+{
+	if (lua_gethook(st->L) == call_lua_callback) {
+		lua_sethook(st->L, NULL, 0, 0);
 	}
 }
 
-static int eli_os_signal_handle(lua_State *L)
+// async-signal-safe, makes wakeup object readable/signalled
+static void signal_wakeup(signal_state *st)
 {
-	int signum = luaL_checkinteger(L, 1);
-	luaL_checktype(L, 2, LUA_TFUNCTION);
 #ifdef _WIN32
-	int event = signal_to_ctrl_event(signum);
-	if (event > -1) {
-		if (subscribedCtrlEvents == 0) {
-			if (!SetConsoleCtrlHandler(windows_ctrl_handler,
-						   TRUE)) {
-				return push_error(
-					L, "failed to set signal handler");
-			}
-		}
-		subscribedCtrlEvents |= (1 << event);
-	}
-	if (signal(signum, standard_signal_handler) == SIG_ERR) {
-		return push_error(L, "failed to set signal handler");
+	if (st->event != NULL) {
+		SetEvent(st->event);
 	}
-#elif defined(LUA_USE_POSIX)
-	struct sigaction sa;
-	sa.sa_handler = standard_signal_handler;
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask); /* do not mask any signal */
-	//sigaction(sig, &sa, NULL);
-	if (sigaction(signum, &sa, NULL) == -1) {
-		return push_error(L, "failed to set signal handler");
+#elif defined(__linux__)
+	if (st->wakeup_write_fd >= 0) {
+		uint64_t one = 1;
+		ssize_t written =
+			write(st->wakeup_write_fd, &one, sizeof(one));
+		(void)written; /* counter saturated, already readable */
 	}
 #else
-	if (signal(signum, standard_signal_handler) == SIG_ERR) {
-		return push_error(L, "failed to set signal handler");
+	if (st->wakeup_write_fd >= 0) {
+		char one = 1;
+		ssize_t written = write(st->wakeup_write_fd, &one, 1);
+		(void)written; /* pipe full, already readable */
 	}
 #endif
+}
 
-	lua_rawgeti(L, LUA_REGISTRYINDEX, handlersRef);
-	lua_pushvalue(L, 2);
-	lua_rawseti(L, -2, signum);
-	lua_pop(L, 1);
+// consumer side, called before queue is drained so no wakeup gets lost
+static void signal_wakeup_clear(signal_state *st)
+{
+#ifdef _WIN32
+	if (st->event != NULL) {
+		ResetEvent(st->event);
+	}
+#elif defined(__linux__)
+	if (st->wakeup_read_fd >= 0) {
+		uint64_t value;
+		ssize_t nread =
+			read(st->wakeup_read_fd, &value, sizeof(value));
+		(void)nread;
+	}
+#else
+	if (st->wakeup_read_fd >= 0) {
+		char buf[64];
+		while (read(st->wakeup_read_fd, buf, sizeof(buf)) > 0) {
+		}
+	}
+#endif
+}
 
+#if !defined(_WIN32) && !defined(__linux__)
+static int set_nonblock_cloexec(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		return -1;
+	}
+	flags = fcntl(fd, F_GETFD);
+	if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+		return -1;
+	}
 	return 0;
 }
+#endif
 
-static int eli_os_signal_reset(lua_State *L)
+static int signal_wakeup_exists(signal_state *st)
 {
-	int signum = luaL_checkinteger(L, 1);
+#ifdef _WIN32
+	return st->event != NULL;
+#else
+	return st->wakeup_read_fd >= 0;
+#endif
+}
 
+// creates wakeup object if it does not exist yet, returns 0 on success
+static int signal_wakeup_open(signal_state *st)
+{
 #ifdef _WIN32
-	int event = signal_to_ctrl_event(signum);
-	if (event > -1 && subscribedCtrlEvents > 0) {
-		// check if subscribedCtrlEvents is 0 or subscribedCtrlEvents - 1 << event is 0
-		subscribedCtrlEvents &= ~(1 << event);
-		if (subscribedCtrlEvents == 0) {
-			if (!SetConsoleCtrlHandler(windows_ctrl_handler,
-						   FALSE)) {
-				return push_error(
-					L, "failed to reset signal handler");
-			}
+	if (st->event == NULL) {
+		st->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (st->event == NULL) {
+			return -1;
 		}
 	}
-	if (signal(signum, SIG_DFL) == SIG_ERR) {
-		return push_error(L, "failed to reset signal handler");
-	}
-#elif defined(LUA_USE_POSIX)
-	struct sigaction sa;
-	sa.sa_handler = signum == SIGINT ? default_lua_sigint_handler : SIG_DFL;
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask); /* do not mask any signal */
-	if (sigaction(signum, &sa, NULL) == -1) {
-		return push_error(L, "failed to reset signal handler");
+#elif defined(__linux__)
+	if (st->wakeup_read_fd < 0) {
+		int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd == -1) {
+			return -1;
+		}
+		st->wakeup_read_fd = fd;
+		st->wakeup_write_fd = fd;
 	}
 #else
-	if (signum == SIGINT) {
-		if (signal(signum, default_lua_sigint_handler) == SIG_ERR) {
-			return push_error(L, "failed to reset signal handler");
+	if (st->wakeup_read_fd < 0) {
+		int fds[2];
+		if (pipe(fds) == -1) {
+			return -1;
 		}
-	} else {
-		if (signal(signum, SIG_DFL) == SIG_ERR) {
-			return push_error(L, "failed to reset signal handler");
+		if (set_nonblock_cloexec(fds[0]) == -1 ||
+		    set_nonblock_cloexec(fds[1]) == -1) {
+			int err = errno;
+			close(fds[0]);
+			close(fds[1]);
+			errno = err;
+			return -1;
 		}
+		st->wakeup_read_fd = fds[0];
+		st->wakeup_write_fd = fds[1];
 	}
 #endif
 	return 0;
 }
 
-static int eli_os_signal_handlers(lua_State *L)
+static void signal_wakeup_close(signal_state *st)
 {
-	// list handlers stored in registry
-	// return copy to avoid modification
-	lua_rawgeti(L, LUA_REGISTRYINDEX, handlersRef);
-	lua_newtable(L);
-	lua_pushnil(L);
-	while (lua_next(L, -3) != 0) {
-		lua_pushvalue(L, -2);
-		lua_pushvalue(L, -2);
-		lua_rawset(L, -6);
-		lua_pop(L, 1);
+#ifdef _WIN32
+	if (st->event != NULL) {
+		CloseHandle(st->event);
+		st->event = NULL;
 	}
-	lua_pop(L, 1);
-
-	return 1;
+#else
+	if (st->wakeup_read_fd >= 0) {
+		close(st->wakeup_read_fd);
+		if (st->wakeup_write_fd != st->wakeup_read_fd) {
+			close(st->wakeup_write_fd);
+		}
+		st->wakeup_read_fd = -1;
+		st->wakeup_write_fd = -1;
+	}
+#endif
 }
 
-static int eli_os_signal_raise(lua_State *L)
+// whether anything is queued or coalesced, used to make a freshly
+// created wakeup object reflect signals which arrived before it existed
+static int signal_state_pending(signal_state *st)
 {
-	int signum = luaL_checkinteger(L, 1);
-	raise(signum);
+	if (atomic_load_explicit(&st->urgent_queue.head,
+				 memory_order_relaxed) !=
+		    atomic_load_explicit(&st->urgent_queue.tail,
+					 memory_order_acquire) ||
+	    atomic_load_explicit(&st->queue.head, memory_order_relaxed) !=
+		    atomic_load_explicit(&st->queue.tail,
+					 memory_order_acquire)) {
+		return 1;
+	}
+	for (int word = 0; word < SIGNAL_MASK_WORDS; word++) {
+		if (atomic_load_explicit(&st->coalesced_mask[word],
+					 memory_order_acquire) != 0) {
+			return 1;
+		}
+	}
 	return 0;
 }
 
-static const struct luaL_Reg eliOsSignal[] = {
-	{ "handle", eli_os_signal_handle },
-	{ "reset", eli_os_signal_reset },
-	{ "handlers", eli_os_signal_handlers },
-	{ "raise", eli_os_signal_raise },
-	{ NULL, NULL },
-};
+// async-signal-safe, counts occurrence and marks signum pending
+static void signal_coalesce_push(signal_state *st, const signal_event *event)
+{
+	int signum = event->signum;
+	atomic_store_explicit(&st->coalesced_ctrl[signum], event->ctrl_event,
+			      memory_order_relaxed);
+	if (atomic_fetch_add_explicit(&st->coalesced_count[signum], 1,
+				      memory_order_acq_rel) == 0) {
+		atomic_store_explicit(&st->coalesced_time[signum], event->time,
+				      memory_order_relaxed);
+		atomic_fetch_or_explicit(&st->coalesced_mask[signum / 32],
+					 1u << (signum % 32),
+					 memory_order_release);
+	} else {
+		atomic_fetch_add_explicit(&st->stats[signum].coalesced, 1,
+					  memory_order_relaxed);
+	}
+}
 
-// NOTE: do not load/open "os.signal" outside of main thread/main lua state
-int luaopen_eli_os_signal(lua_State *L)
+// fills info table on top of the stack
+static void set_signal_info(lua_State *L, const signal_info *info)
 {
-#ifdef _WIN32
-	InitializeCriticalSection(&SignalCriticalSection);
-#endif
+	lua_pushinteger(L, info->pid);
+	lua_setfield(L, -2, "pid");
+	lua_pushinteger(L, info->uid);
+	lua_setfield(L, -2, "uid");
+	lua_pushinteger(L, info->code);
+	lua_setfield(L, -2, "code");
+	lua_pushinteger(L, info->status);
+	lua_setfield(L, -2, "status");
+	lua_pushinteger(L, info->value);
+	lua_setfield(L, -2, "value");
+}
 
-	mainL = L;
-	lua_newtable(L);
-	handlersRef = luaL_ref(L, LUA_REGISTRYINDEX);
+static void push_signal_info(lua_State *L, const signal_info *info)
+{
+	lua_createtable(L, 0, 5);
+	set_signal_info(L, info);
+}
 
-	lua_newtable(L);
-	luaL_setfuncs(L, eliOsSignal, 0);
-
-	// add common signals - SIGTERM, SIGKILL and SIGINT...
-	lua_pushinteger(L, SIGTERM);
-	lua_setfield(L, -2, "SIGTERM");
-	lua_pushinteger(L, 9 /*SIGKILL*/);
-	lua_setfield(L, -2, "SIGKILL");
-	lua_pushinteger(L, SIGINT);
-	lua_setfield(L, -2, "SIGINT");
-	lua_pushinteger(L, 13 /*SIGPIPE*/);
-	lua_setfield(L, -2, "SIGPIPE");
-	lua_pushinteger(L, 21 /* SIGBREAK */);
-	lua_setfield(L, -2, "SIGBREAK"); // windows
+static void call_handler(lua_State *L, signal_counters *stats, int nargs)
+{
+	if (lua_pcall(L, nargs, 0, 0) != LUA_OK) {
+		stats->errors++;
+		lua_writestringerror("error calling signal handler: %s\n",
+				     lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+// calls handlers of event signum (if any) in priority order, third
+// argument is occurrence count for coalesced handlers or info table for
+// siginfo handlers; allocates nothing in the lua heap
+static void invoke_lua_handler(lua_State *L, signal_state *st,
+			       const signal_event *event, lua_Integer count)
+{
+	int signum = event->signum;
+	signal_counters *stats = &st->stats[signum];
+	// handler arrays are replaced, never modified in place, so handlers
+	// adding or removing handlers do not disturb this iteration
+	int type = lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlerRefs[signum]);
+	if (type != LUA_TFUNCTION && type != LUA_TTABLE) {
+		lua_pop(L, 1);
+		return;
+	}
+	int list = lua_gettop(L);
+	int nargs = 2;
+	if (count > 0) {
+		lua_pushinteger(L, count);
+		nargs++;
+	} else if (event->has_info) {
+		if (lua_rawgeti(L, LUA_REGISTRYINDEX, st->infoRefs[signum]) ==
+		    LUA_TTABLE) {
+			set_signal_info(L, &event->info);
+		} else {
+			lua_pop(L, 1);
+			push_signal_info(L, &event->info);
+		}
+		nargs++;
+	}
+	// single handler is referenced directly, more of them as array
+	int many = type == LUA_TTABLE;
+	lua_Integer n = many ? (lua_Integer)lua_rawlen(L, list) : 1;
+	for (lua_Integer i = 1; i <= n; i++) {
+		if (many) {
+			lua_rawgeti(L, list, i);
+		} else {
+			lua_pushvalue(L, list);
+		}
+		lua_pushinteger(L, signum);
+		if (event->ctrl_event != SIGNAL_CTRL_NONE) {
+			lua_pushinteger(L, event->ctrl_event);
+		} else {
+			lua_pushboolean(L, 0);
+		}
+		if (nargs > 2) {
+			lua_pushvalue(L, list + 1);
+		}
+		call_handler(L, stats, nargs);
+	}
+	lua_settop(L, list - 1);
+	stats->dispatched++;
+	stats->latency_ns += eli_monotonic_ns() - event->time;
+}
+
+// moves coroutines awaiting event signum to the ready list; signum stays
+// subscribed, a resumed coroutine awaiting it again must not miss it
+static void wake_waiters(lua_State *L, signal_state *st,
+			 const signal_event *event, lua_Integer count)
+{
+	int signum = event->signum;
+	if (st->waiting[signum] == 0) {
+		return;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->waitersRef);
+	lua_rawgeti(L, -1, signum);
+	lua_pushnil(L);
+	lua_rawseti(L, -3, signum);
+	st->waiting[signum] = 0;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->readyRef);
+	lua_Integer ready = (lua_Integer)lua_rawlen(L, -1);
+	lua_Integer n = (lua_Integer)lua_rawlen(L, -2);
+	for (lua_Integer i = 1; i <= n; i++) {
+		lua_createtable(L, 4, 0);
+		lua_rawgeti(L, -3, i);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, signum);
+		lua_rawseti(L, -2, 2);
+		if (event->ctrl_event != SIGNAL_CTRL_NONE) {
+			lua_pushinteger(L, event->ctrl_event);
+		} else {
+			lua_pushboolean(L, 0);
+		}
+		lua_rawseti(L, -2, 3);
+		if (count > 0) {
+			lua_pushinteger(L, count);
+			lua_rawseti(L, -2, 4);
+		} else if (event->has_info) {
+			// own copy, the shared info table is overwritten
+			push_signal_info(L, &event->info);
+			lua_rawseti(L, -2, 4);
+		}
+		lua_rawseti(L, -2, ++ready);
+	}
+	lua_pop(L, 3);
+}
+
+// runs queued handlers, returns number of signals dispatched
+static int dispatch_signals(lua_State *L, signal_state *st)
+{
+	int dispatched = 0;
+	signal_wakeup_clear(st);
+	// drain in place, at most one queue length per hook so a handler
+	// raising signals cannot keep us here forever
+	signal_event event;
+	int budget = ELI_SIGNAL_QUEUE_SIZE;
+	while (budget-- > 0 && signal_next_event(st, &event)) {
+		invoke_lua_handler(L, st, &event, 0);
+		wake_waiters(L, st, &event, 0);
+#ifdef _WIN32
+		signal_ctrl_done(event.ctrl_event);
+#endif
+		dispatched++;
+	}
+
+	// coalesced signals, one call per signum regardless of occurrences
+	for (int word = 0; word < SIGNAL_MASK_WORDS; word++) {
+		unsigned int bits = atomic_exchange_explicit(
+			&st->coalesced_mask[word], 0, memory_order_acquire);
+		for (int bit = 0; bits != 0; bit++, bits >>= 1) {
+			if ((bits & 1u) == 0) {
+				continue;
+			}
+			int signum = word * 32 + bit;
+			unsigned int count = atomic_exchange_explicit(
+				&st->coalesced_count[signum], 0,
+				memory_order_acq_rel);
+			if (count == 0) {
+				continue;
+			}
+			event.signum = signum;
+			event.ctrl_event = atomic_load_explicit(
+				&st->coalesced_ctrl[signum],
+				memory_order_relaxed);
+			event.has_info = 0;
+			event.time = atomic_load_explicit(
+				&st->coalesced_time[signum],
+				memory_order_relaxed);
+			invoke_lua_handler(L, st, &event, count);
+			wake_waiters(L, st, &event, count);
+#ifdef _WIN32
+			signal_ctrl_done(event.ctrl_event);
+#endif
+			dispatched++;
+		}
+	}
+	if (budget < 0) {
+		/* leftovers, continue on next instruction */
+		arm_lua_callback(st);
+		signal_wakeup(st); /* and keep poller awake */
+	}
+	return dispatched;
+}
+
+static signal_state *find_signal_state(lua_State *L)
+{
+	for (int i = 0; i < ELI_SIGNAL_MAX_STATES; i++) {
+		signal_state *st = atomic_load(&signal_states[i]);
+		if (st != NULL && st->L == L) {
+			return st;
+		}
+	}
+	return NULL;
+}
+
+static void call_lua_callback(lua_State *L, lua_Debug *ar)
+{
+	(void)ar; /* unused arg. */
+	lua_sethook(L, NULL, 0, 0); /* reset hook */
+	signal_state *st = find_signal_state(L);
+	// hook armed before signal.block, flushed by signal.unblock
+	if (st != NULL && st->defer_depth == 0) {
+		dispatch_signals(L, st);
+	}
+}
+
+// async-signal-safe, gets queued signum dispatched by the owning thread
+static void signal_state_notify(signal_state *st, int signum)
+{
+	st->last_signum = signum;
+#ifdef LUA_USE_POSIX
+	if (!pthread_equal(pthread_self(), st->owner)) {
+		atomic_store(&st->arm_requested, 1);
+		signal_wakeup(st);
+		if (st->dispatch_mode != SIGNAL_DISPATCH_POLL) {
+			pthread_kill(st->owner, ELI_SIGNAL_KICK);
+		}
+		return;
+	}
+#endif
+	arm_lua_callback(st);
+	signal_wakeup(st);
+}
+
+// async-signal-safe, queues event to a single subscribed state,
+// returns 0 if it was dropped
+static int signal_state_push(signal_state *st, const signal_event *event)
+{
+	int signum = event->signum;
+	signal_ring *ring = st->urgent[signum] ? &st->urgent_queue : &st->queue;
+	atomic_fetch_add_explicit(&st->stats[signum].received, 1,
+				  memory_order_relaxed);
+	if (st->coalesce[signum]) {
+		signal_coalesce_push(st, event);
+	} else if (st->siginfo[signum] || !event->has_info) {
+		if (!signal_queue_push(st, ring, event)) {
+			return 0;
+		}
+	} else {
+		signal_event plain = *event;
+		plain.has_info = 0;
+		if (!signal_queue_push(st, ring, &plain)) {
+			return 0;
+		}
+	}
+	signal_state_notify(st, signum);
+	return 1;
+}
+
+#if defined(ELI_CHILD_WATCH_PIDFD) || defined(ELI_CHILD_WATCH_HANDLE)
+// queues child exit event to st if it is still registered, the event
+// keeps its info and is never coalesced
+static void signal_state_push_child(signal_state *st, const signal_event *event)
+{
+	atomic_fetch_add(&signal_states_busy, 1);
+	for (int i = 0; i < ELI_SIGNAL_MAX_STATES; i++) {
+		if (atomic_load(&signal_states[i]) != st) {
+			continue;
+		}
+		int signum = event->signum;
+		signal_ring *ring = st->urgent[signum] ? &st->urgent_queue :
+							 &st->queue;
+		atomic_fetch_add_explicit(&st->stats[signum].received, 1,
+					  memory_order_relaxed);
+		if (signal_queue_push(st, ring, event)) {
+			signal_state_notify(st, signum);
+		}
+		break;
+	}
+	atomic_fetch_sub(&signal_states_busy, 1);
+}
+#endif
+
+// inspired by https://github.com/luaposix/luaposix/blob/aa2c8bf5af2eef5dd1e3de5f6ca55b90427c1b58/ext/posix/signal.c#L158
+// and lua.c#70 (laction), returns number of states event was queued to
+static int trigger_signal_event(const signal_event *event)
+{
+	int saved_errno = errno;
+	int queued = 0;
+	int signum = event->signum;
+	if (signum > 0 && signum < ELI_SIGNAL_MAX) {
+		// states unsubscribing wait until no handler is fanning out
+		atomic_fetch_add(&signal_states_busy, 1);
+		signal_event stamped = *event;
+		stamped.time = eli_monotonic_ns();
+		for (int i = 0; i < ELI_SIGNAL_MAX_STATES; i++) {
+			signal_state *st = atomic_load(&signal_states[i]);
+			if (st != NULL && st->handled[signum]) {
+				queued += signal_state_push(st, &stamped);
+			}
+		}
+		atomic_fetch_sub(&signal_states_busy, 1);
+	}
+	errno = saved_errno;
+	return queued;
+}
+
+static int trigger_lua_callback(int signum, int ctrl_event)
+{
+	signal_event event;
+	event.signum = signum;
+	event.ctrl_event = ctrl_event;
+	event.has_info = 0;
+	return trigger_signal_event(&event);
+}
+
+// installs eli handler as process wide disposition of signum
+static int install_signal_handler(int signum, const signal_options *opts)
+{
+	signal_resethand[signum] = (opts->flags & SIGNAL_OPT_RESETHAND) != 0;
+#ifdef _WIN32
+	if (update_ctrl_handler() != 0) {
+		return -1;
+	}
+#ifdef ELI_PSEUDO_SIGCHLD
+	if (signum == SIGCHLD) {
+		return 0; // only fed by signal.watch_child
+	}
+#endif
+	if (signal(signum, standard_signal_handler) == SIG_ERR) {
+		return -1;
+	}
+#elif defined(LUA_USE_POSIX)
+	// always SA_SIGINFO, states which did not ask for payload drop it
+	struct sigaction sa;
+	sa.sa_sigaction = siginfo_signal_handler;
+	sa.sa_flags = SA_SIGINFO;
+	if (opts->flags & SIGNAL_OPT_RESTART) {
+		sa.sa_flags |= SA_RESTART;
+	}
+	if (opts->flags & SIGNAL_OPT_NODEFER) {
+		sa.sa_flags |= SA_NODEFER;
+	}
+	if (opts->flags & SIGNAL_OPT_RESETHAND) {
+		sa.sa_flags |= SA_RESETHAND;
+	}
+#ifdef SA_ONSTACK
+	if (opts->flags & SIGNAL_OPT_ONSTACK) {
+		sa.sa_flags |= SA_ONSTACK;
+	}
+#endif
+	sigemptyset(&sa.sa_mask);
+	for (int i = 1; i < ELI_SIGNAL_MAX; i++) {
+		if (opts->mask[i / 32] & (1u << (i % 32))) {
+			sigaddset(&sa.sa_mask, i);
+		}
+	}
+	//sigaction(sig, &sa, NULL);
+	if (sigaction(signum, &sa, NULL) == -1) {
+		return -1;
+	}
+#else
+	if (signal(signum, standard_signal_handler) == SIG_ERR) {
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+// restores default disposition of signum
+static int restore_signal_handler(int signum)
+{
+#ifdef _WIN32
+	if (update_ctrl_handler() != 0) {
+		return -1;
+	}
+#ifdef ELI_PSEUDO_SIGCHLD
+	if (signum == SIGCHLD) {
+		return 0;
+	}
+#endif
+	if (signal(signum, SIG_DFL) == SIG_ERR) {
+		return -1;
+	}
+#elif defined(LUA_USE_POSIX)
+	struct sigaction sa;
+	sa.sa_handler = signum == SIGINT ? default_lua_sigint_handler : SIG_DFL;
+	sa.sa_flags = 0;
+	if (signum == ELI_SIGNAL_KICK && signal_kick_installed) {
+		sa.sa_handler = signal_kick_handler;
+		sa.sa_flags = SA_RESTART;
+	}
+	sigemptyset(&sa.sa_mask); /* do not mask any signal */
+	if (sigaction(signum, &sa, NULL) == -1) {
+		return -1;
+	}
+#else
+	if (signum == SIGINT) {
+		if (signal(signum, default_lua_sigint_handler) == SIG_ERR) {
+			return -1;
+		}
+	} else {
+		if (signal(signum, SIG_DFL) == SIG_ERR) {
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+
+// subscribes state to signum, returns 0 on success (errno set otherwise),
+// called with registry lock held
+static int signal_subscribe_locked(signal_state *st, int signum,
+				   const signal_options *opts)
+{
+	int subscribed = !st->handled[signum];
+	if (subscribed) {
+		// first mark, then install - no delivery gets lost
+		st->handled[signum] = 1;
+		signal_subscribers[signum]++;
+	}
+	int res = install_signal_handler(signum, opts);
+	if (res != 0 && subscribed) {
+		int err = errno;
+		st->handled[signum] = 0;
+		signal_subscribers[signum]--;
+		errno = err;
+	}
+	return res;
+}
+
+static int signal_subscribe(signal_state *st, int signum,
+			    const signal_options *opts)
+{
+	signal_registry_acquire();
+	int res = signal_subscribe_locked(st, signum, opts);
+	signal_registry_release();
+	return res;
+}
+
+// unsubscribes state from signum, default disposition is restored once
+// no state handles the signal anymore, called with registry lock held
+static int signal_unsubscribe_locked(signal_state *st, int signum)
+{
+	if (st->handled[signum]) {
+		st->handled[signum] = 0;
+		signal_subscribers[signum]--;
+	}
+	int res = 0;
+	if (signal_subscribers[signum] == 0) {
+		res = restore_signal_handler(signum);
+	}
+	return res;
+}
+
+static int signal_unsubscribe(signal_state *st, int signum)
+{
+	signal_registry_acquire();
+	int res = signal_unsubscribe_locked(st, signum);
+	signal_registry_release();
+	return res;
+}
+
+#ifdef LUA_USE_POSIX
+// blocks signums in calling thread so batch changes are seen all at once
+static void signal_block_batch(const int *signums, int count, sigset_t *old)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	for (int i = 0; i < count; i++) {
+		sigaddset(&set, signums[i]);
+	}
+	pthread_sigmask(SIG_BLOCK, &set, old);
+}
+#endif
+
+static int signal_state_gc(lua_State *L)
+{
+	signal_state *st = (signal_state *)lua_touserdata(L, 1);
+	if (st->slot < 0) {
+		return 0;
+	}
+	for (int signum = 1; signum < ELI_SIGNAL_MAX; signum++) {
+		if (st->handled[signum]) {
+			signal_unsubscribe(st, signum);
+		}
+	}
+	child_watch_release(st, 0, 1);
+	atomic_store(&signal_states[st->slot], NULL);
+	signal_state *self = st;
+	atomic_compare_exchange_strong(&primary_state, &self, NULL);
+	st->slot = -1;
+	// handlers which already picked the state up must finish first
+	while (atomic_load(&signal_states_busy) != 0) {
+	}
+	disarm_lua_callback(st);
+	signal_wakeup_close(st);
+	return 0;
+}
+
+// creates subscription of lua state and pushes it, NULL if no slot is free
+static signal_state *signal_state_new(lua_State *L)
+{
+	signal_state *st =
+		(signal_state *)lua_newuserdatauv(L, sizeof(signal_state), 0);
+	memset((void *)st, 0, sizeof(signal_state));
+	st->slot = -1;
+	st->handlersRef = LUA_NOREF;
+	st->handlersViewRef = LUA_NOREF;
+	st->waitersRef = LUA_NOREF;
+	st->readyRef = LUA_NOREF;
+	for (int i = 0; i < ELI_SIGNAL_MAX; i++) {
+		st->handlerRefs[i] = LUA_NOREF;
+		st->infoRefs[i] = LUA_NOREF;
+	}
+#ifdef _WIN32
+	st->event = NULL;
+#else
+	st->wakeup_read_fd = -1;
+	st->wakeup_write_fd = -1;
+#endif
+	signal_queue_init(&st->queue);
+	signal_queue_init(&st->urgent_queue);
+	atomic_init(&st->dropped, 0);
+	atomic_init(&st->max_depth, 0);
+	for (int i = 0; i < ELI_SIGNAL_MAX; i++) {
+		atomic_init(&st->coalesced_count[i], 0);
+		atomic_init(&st->coalesced_ctrl[i], 0);
+		atomic_init(&st->coalesced_time[i], 0);
+		atomic_init(&st->stats[i].received, 0);
+		atomic_init(&st->stats[i].dropped, 0);
+		atomic_init(&st->stats[i].coalesced, 0);
+	}
+	for (int i = 0; i < SIGNAL_MASK_WORDS; i++) {
+		atomic_init(&st->coalesced_mask[i], 0);
+	}
+	st->dispatch_mode = SIGNAL_DISPATCH_HOOK;
+	st->dispatch_hook_mask =
+		LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT;
+	st->dispatch_hook_count = 1;
+
+	// hooks are armed on the main thread, os.signal may be required
+	// from a coroutine
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	st->L = lua_tothread(L, -1);
+	lua_pop(L, 1);
+	lua_newtable(L);
+	st->handlersRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_newtable(L);
+	st->waitersRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_newtable(L);
+	st->readyRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if (luaL_newmetatable(L, SIGNAL_STATE_METATABLE)) {
+		lua_pushcfunction(L, signal_state_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+#ifdef LUA_USE_POSIX
+	// handlers read the owner as soon as the state is registered
+	st->owner = pthread_self();
+	atomic_init(&st->arm_requested, 0);
+#endif
+
+	for (int i = 0; i < ELI_SIGNAL_MAX_STATES; i++) {
+		signal_state *expected = NULL;
+		if (atomic_compare_exchange_strong(&signal_states[i],
+						   &expected, st)) {
+			st->slot = i;
+			break;
+		}
+	}
+	if (st->slot < 0) {
+		return NULL;
+	}
+	signal_state *none = NULL;
+	atomic_compare_exchange_strong(&primary_state, &none, st);
+#ifdef LUA_USE_POSIX
+	signal_registry_acquire();
+	signal_kick_install();
+	signal_registry_release();
+#endif
+	return st;
+}
+
+static int get_option_flag(lua_State *L, int idx, const char *name, int flag)
+{
+	lua_getfield(L, idx, name);
+	int set = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	return set ? flag : 0;
+}
+
+// reads sigaction related fields of options table at idx
+static void check_signal_options(lua_State *L, int idx, signal_options *opts)
+{
+	memset(opts, 0, sizeof(signal_options));
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+	opts->flags = get_option_flag(L, idx, "restart", SIGNAL_OPT_RESTART) |
+		      get_option_flag(L, idx, "nodefer", SIGNAL_OPT_NODEFER) |
+		      get_option_flag(L, idx, "resethand",
+				      SIGNAL_OPT_RESETHAND) |
+		      get_option_flag(L, idx, "onstack", SIGNAL_OPT_ONSTACK);
+	if (lua_getfield(L, idx, "mask") == LUA_TTABLE) {
+		size_t count = lua_rawlen(L, -1);
+		for (size_t i = 1; i <= count; i++) {
+			lua_rawgeti(L, -1, i);
+			int signum = (int)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX,
+				      idx, "invalid signal in mask");
+			opts->mask[signum / 32] |= 1u << (signum % 32);
+		}
+	}
+	lua_pop(L, 1);
+}
+
+/*
+** Sleeps up to ns nanoseconds, waking early once a signal handled by the
+** lua state gets queued. Returns remaining ns (0 if slept whole duration)
+** and stores the waking signum (0 if unknown), -1 (errno set) on failure.
+*/
+int64_t eli_signal_sleep_ns(lua_State *L, int64_t ns, int *signum)
+{
+	*signum = 0;
+	signal_state *st = NULL;
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &signalStateKey) ==
+	    LUA_TUSERDATA) {
+		st = (signal_state *)lua_touserdata(L, -1);
+	}
+	lua_pop(L, 1);
+
+	int64_t deadline = eli_monotonic_ns() + ns;
+	int created = st != NULL && !signal_wakeup_exists(st);
+	if (st == NULL || signal_wakeup_open(st) != 0) {
+#ifdef _WIN32
+		// nothing to wake us up
+		return eli_sleep_ns(ns) == 0 ? 0 : -1;
+#else
+		// os.signal not loaded, any handled signal interrupts nanosleep
+		struct timespec req, rem;
+		req.tv_sec = (time_t)(ns / 1000000000LL);
+		req.tv_nsec = (long)(ns % 1000000000LL);
+		if (nanosleep(&req, &rem) == 0) {
+			return 0;
+		}
+		if (errno != EINTR) {
+			return -1;
+		}
+		return (int64_t)rem.tv_sec * 1000000000LL + rem.tv_nsec;
+#endif
+	}
+	// signals queued before the wakeup existed never signalled it
+	if (created && signal_state_pending(st)) {
+		signal_wakeup(st);
+	}
+
+	for (;;) {
+		int64_t remaining = deadline - eli_monotonic_ns();
+		if (remaining <= 0) {
+			return 0;
+		}
+#ifdef _WIN32
+		DWORD ms = (DWORD)((remaining + 999999) / 1000000);
+		DWORD res = WaitForSingleObjectEx(st->event, ms, TRUE);
+		if (res == WAIT_OBJECT_0) {
+			*signum = st->last_signum;
+			return remaining;
+		}
+		if (res == WAIT_FAILED) {
+			errno = EINVAL;
+			return -1;
+		}
+#else
+		struct pollfd pfd;
+		pfd.fd = st->wakeup_read_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+#ifdef __linux__
+		struct timespec ts;
+		ts.tv_sec = (time_t)(remaining / 1000000000LL);
+		ts.tv_nsec = (long)(remaining % 1000000000LL);
+		int res = ppoll(&pfd, 1, &ts, NULL);
+#else
+		int res = poll(&pfd, 1, (int)((remaining + 999999) / 1000000));
+#endif
+		if (res > 0) {
+			*signum = st->last_signum;
+			remaining = deadline - eli_monotonic_ns();
+			return remaining > 0 ? remaining : 0;
+		}
+		if (res == -1 && errno != EINTR) {
+			return -1;
+		}
+#endif
+	}
+}
+
+// reads coalesce/siginfo fields of options table at idx
+static void check_handler_mode(lua_State *L, int idx, int *coalesce,
+			       int *siginfo)
+{
+	*coalesce = 0;
+	*siginfo = 0;
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+	luaL_checktype(L, idx, LUA_TTABLE);
+	lua_getfield(L, idx, "coalesce");
+	*coalesce = lua_toboolean(L, -1);
+	lua_getfield(L, idx, "siginfo");
+	*siginfo = lua_toboolean(L, -1);
+	lua_pop(L, 2);
+	luaL_argcheck(L, !(*coalesce && *siginfo), idx,
+		      "coalesce and siginfo are mutually exclusive");
+}
+
+// reads priority/urgent fields of options table at idx
+static void check_handler_order(lua_State *L, int idx, int coalesce,
+				lua_Integer *priority, int *urgent)
+{
+	*priority = 0;
+	*urgent = 0;
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+	lua_getfield(L, idx, "priority");
+	luaL_argcheck(L, lua_isnoneornil(L, -1) || lua_isinteger(L, -1), idx,
+		      "priority must be an integer");
+	*priority = lua_tointeger(L, -1);
+	lua_getfield(L, idx, "urgent");
+	*urgent = lua_toboolean(L, -1);
+	lua_pop(L, 2);
+	luaL_argcheck(L, !(*urgent && coalesce), idx,
+		      "urgent and coalesce are mutually exclusive");
+}
+
+static void push_handler_entry(lua_State *L, int fnidx, lua_Integer priority)
+{
+	lua_createtable(L, 2, 0);
+	lua_pushvalue(L, fnidx);
+	lua_rawseti(L, -2, SIGNAL_HANDLER_FN);
+	lua_pushinteger(L, priority);
+	lua_rawseti(L, -2, SIGNAL_HANDLER_PRIORITY);
+}
+
+// rebuilds dispatch view (handlerRefs) of signum from handlersRef
+static void sync_handler_refs(lua_State *L, signal_state *st, int signum)
+{
+	luaL_unref(L, LUA_REGISTRYINDEX, st->handlerRefs[signum]);
+	st->handlerRefs[signum] = LUA_NOREF;
+	st->handlers_version++;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersRef);
+	if (lua_rawgeti(L, -1, signum) != LUA_TTABLE) {
+		lua_pop(L, 2);
+		return;
+	}
+	lua_Integer n = (lua_Integer)lua_rawlen(L, -1);
+	if (n == 1) {
+		lua_rawgeti(L, -1, 1);
+		lua_rawgeti(L, -1, SIGNAL_HANDLER_FN);
+		lua_remove(L, -2);
+	} else {
+		lua_createtable(L, (int)n, 0);
+		for (lua_Integer i = 1; i <= n; i++) {
+			lua_rawgeti(L, -2, i);
+			lua_rawgeti(L, -1, SIGNAL_HANDLER_FN);
+			lua_remove(L, -2);
+			lua_rawseti(L, -2, i);
+		}
+	}
+	st->handlerRefs[signum] = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pop(L, 2);
+}
+
+// preallocates info table reused by siginfo deliveries of signum
+static void ensure_info_table(lua_State *L, signal_state *st, int signum)
+{
+	if (st->infoRefs[signum] != LUA_NOREF) {
+		return;
+	}
+	lua_createtable(L, 0, 5);
+	st->infoRefs[signum] = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+// replaces handler list of signum by a copy with function at fnidx
+// inserted after handlers of same or higher priority, `replace` drops
+// previous handlers
+static void add_handler_entry(lua_State *L, signal_state *st, int signum,
+			      int fnidx, lua_Integer priority, int replace)
+{
+	fnidx = lua_absindex(L, fnidx);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersRef);
+	int handlers = lua_gettop(L);
+	lua_newtable(L);
+	int list = handlers + 1;
+	lua_Integer n = 0;
+	int inserted = 0;
+	if (!replace && lua_rawgeti(L, handlers, signum) == LUA_TTABLE) {
+		lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+		for (lua_Integer i = 1; i <= count; i++) {
+			lua_rawgeti(L, list + 1, i);
+			lua_rawgeti(L, -1, SIGNAL_HANDLER_PRIORITY);
+			lua_Integer current = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			if (!inserted && priority > current) {
+				push_handler_entry(L, fnidx, priority);
+				lua_rawseti(L, list, ++n);
+				inserted = 1;
+			}
+			lua_rawseti(L, list, ++n);
+		}
+	}
+	lua_settop(L, list);
+	if (!inserted) {
+		push_handler_entry(L, fnidx, priority);
+		lua_rawseti(L, list, ++n);
+	}
+	lua_rawseti(L, handlers, signum);
+	lua_pop(L, 1);
+	sync_handler_refs(L, st, signum);
+}
+
+// replaces handler list of signum by a copy without function at fnidx,
+// returns number of remaining handlers or -1 if function was not found
+static int remove_handler_entry(lua_State *L, signal_state *st, int signum,
+				int fnidx)
+{
+	fnidx = lua_absindex(L, fnidx);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersRef);
+	int handlers = lua_gettop(L);
+	if (lua_rawgeti(L, handlers, signum) != LUA_TTABLE) {
+		lua_settop(L, handlers - 1);
+		return -1;
+	}
+	lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+	lua_createtable(L, (int)count, 0);
+	int list = handlers + 2;
+	int n = 0, found = 0;
+	for (lua_Integer i = 1; i <= count; i++) {
+		lua_rawgeti(L, handlers + 1, i);
+		lua_rawgeti(L, -1, SIGNAL_HANDLER_FN);
+		int match = !found && lua_rawequal(L, -1, fnidx);
+		lua_pop(L, 1);
+		if (match) {
+			found = 1;
+			lua_pop(L, 1);
+			continue;
+		}
+		lua_rawseti(L, list, ++n);
+	}
+	if (found) {
+		if (n == 0) {
+			lua_pushnil(L);
+			lua_replace(L, list);
+		}
+		lua_rawseti(L, handlers, signum);
+	}
+	lua_settop(L, handlers - 1);
+	if (!found) {
+		return -1;
+	}
+	sync_handler_refs(L, st, signum);
+	return n;
+}
+
+static void clear_handler_entries(lua_State *L, signal_state *st, int signum)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersRef);
+	lua_pushnil(L);
+	lua_rawseti(L, -2, signum);
+	lua_pop(L, 1);
+	sync_handler_refs(L, st, signum);
+}
+
+// drops coroutines parked by signal.await on signum after unsubscribe,
+// they would never be woken
+static void clear_waiters(lua_State *L, signal_state *st, int signum)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->waitersRef);
+	lua_pushnil(L);
+	lua_rawseti(L, -2, signum);
+	lua_pop(L, 1);
+	st->waiting[signum] = 0;
+}
+
+// drops per state delivery mode of signum after unsubscribe
+static void signal_clear_mode(signal_state *st, int signum)
+{
+	st->coalesce[signum] = 0;
+	st->siginfo[signum] = 0;
+	st->urgent[signum] = 0;
+	atomic_store_explicit(&st->coalesced_count[signum], 0,
+			      memory_order_relaxed);
+}
+
+/*
+---#DES 'signal.handle'
+---
+---Sets handler for signal. Handler is called with signum and kind of the
+---(windows) console control event the signal originates from - one of
+---signal.CTRL_C, CTRL_BREAK, CTRL_CLOSE, CTRL_LOGOFF, CTRL_SHUTDOWN, or
+---false. Console handler waits for CTRL_CLOSE/LOGOFF/SHUTDOWN handlers to
+---finish (see signal.set_ctrl_budget) before windows terminates the process.
+---With `coalesce` option set, repeated deliveries are merged and handler is
+---called once per dispatch with number of occurrences as third argument.
+---With `siginfo` option set (posix only), handler receives info table
+---(pid, uid, code, status, value) as third argument. The table is reused
+---for every delivery, copy it if needed after the handler returns.
+---Each lua state has its own handlers, a signal is delivered to every
+---state which handles it.
+---Replaces all handlers of the signal, see signal.add_handler to register
+---more of them. Queued signals are dispatched in arrival order; `urgent`
+---signals are dispatched before any other queued signal (not with
+---`coalesce`). `priority` orders handlers of the same signal (higher first).
+---Remaining options map to sigaction flags and are process wide:
+--- - restart - SA_RESTART, interrupted syscalls are restarted
+--- - mask - signals blocked while the handler runs
+--- - nodefer - SA_NODEFER, signal is not blocked in its own handler
+--- - resethand - SA_RESETHAND, default disposition after first delivery
+--- - onstack - SA_ONSTACK, handler runs on sigaltstack
+---Without sigaction only `resethand` is honored.
+---Returns nil, error desc and errno on failure.
+---@param signum integer
+---@param handler fun(signum: integer, ctrl_event: integer|false, count_or_info: integer|table?)
+---@param options { coalesce: boolean?, siginfo: boolean?, urgent: boolean?, priority: integer?, restart: boolean?, mask: integer[]?, nodefer: boolean?, resethand: boolean?, onstack: boolean? }?
+*/
+static int set_signal_handler(lua_State *L, int replace)
+{
+	signal_state *st = get_signal_state(L);
+	int signum = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+		      "invalid signal");
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	int coalesce, siginfo, urgent;
+	lua_Integer priority;
+	check_handler_mode(L, 3, &coalesce, &siginfo);
+	check_handler_order(L, 3, coalesce, &priority, &urgent);
+	signal_options opts;
+	check_signal_options(L, 3, &opts);
+	// switch mode before the handler is installed so no delivery is
+	// accounted to the wrong path
+	int old_coalesce = st->coalesce[signum];
+	int old_siginfo = st->siginfo[signum];
+	int old_urgent = st->urgent[signum];
+	st->coalesce[signum] = coalesce;
+	st->siginfo[signum] = siginfo;
+	st->urgent[signum] = urgent;
+
+	// subscribe first, a failed call leaves handlers untouched; queued
+	// deliveries are dispatched only after we return to lua
+	if (signal_subscribe(st, signum, &opts) != 0) {
+		st->coalesce[signum] = old_coalesce;
+		st->siginfo[signum] = old_siginfo;
+		st->urgent[signum] = old_urgent;
+		return push_error(L, "failed to set signal handler");
+	}
+	add_handler_entry(L, st, signum, 2, priority, replace);
+	if (siginfo) {
+		ensure_info_table(L, st, signum);
+	}
+	return 0;
+}
+
+static int eli_os_signal_handle(lua_State *L)
+{
+	return set_signal_handler(L, 1);
+}
+
+/*
+---#DES 'signal.add_handler'
+---
+---Adds handler to the handlers of signal. Handlers run in `priority`
+---order (higher first, default 0), same priority in order of addition.
+---Delivery options (coalesce, siginfo, urgent and sigaction flags) apply
+---to the signal as a whole and replace those of previous calls.
+---Returns nil, error desc and errno on failure.
+---@param signum integer
+---@param handler fun(signum: integer, ctrl_event: integer|false, count_or_info: integer|table?)
+---@param options { coalesce: boolean?, siginfo: boolean?, urgent: boolean?, priority: integer?, restart: boolean?, mask: integer[]?, nodefer: boolean?, resethand: boolean?, onstack: boolean? }?
+*/
+static int eli_os_signal_add_handler(lua_State *L)
+{
+	return set_signal_handler(L, 0);
+}
+
+/*
+---#DES 'signal.remove_handler'
+---
+---Removes handler from the handlers of signal. Once the last handler is
+---removed, the signal is reset.
+---Returns true if handler was removed, false if it was not registered,
+---nil, error desc and errno on failure.
+---@param signum integer
+---@param handler function
+---@return boolean?, string?, integer?
+*/
+static int eli_os_signal_remove_handler(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int signum = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+		      "invalid signal");
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+
+	int remaining = remove_handler_entry(L, st, signum, 2);
+	if (remaining < 0) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	// awaited signals stay subscribed until their waiters are woken
+	if (remaining == 0 && st->waiting[signum] == 0) {
+		if (signal_unsubscribe(st, signum) != 0) {
+			return push_error(L, "failed to reset signal handler");
+		}
+		signal_clear_mode(st, signum);
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int eli_os_signal_reset(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int signum = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+		      "invalid signal");
+
+	if (signal_unsubscribe(st, signum) != 0) {
+		return push_error(L, "failed to reset signal handler");
+	}
+	signal_clear_mode(st, signum);
+	clear_handler_entries(L, st, signum);
+	clear_waiters(L, st, signum);
+	return 0;
+}
+
+/*
+---#DES 'signal.handle_many'
+---
+---Sets handlers for all signals of the table (signum -> handler) in one
+---pass. Options are shared and have the same meaning as in signal.handle.
+---The signals are blocked while handlers get installed, so none of them
+---is delivered to a partially configured set. If any install fails, all
+---signals of the table are reset.
+---Returns nil, error desc and errno on failure.
+---@param handlers table<integer, fun(signum: integer, ctrl_event: integer|false, count_or_info: integer|table?)>
+---@param options { coalesce: boolean?, siginfo: boolean?, urgent: boolean?, priority: integer?, restart: boolean?, mask: integer[]?, nodefer: boolean?, resethand: boolean?, onstack: boolean? }?
+*/
+static int eli_os_signal_handle_many(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int coalesce, siginfo, urgent;
+	lua_Integer priority;
+	check_handler_mode(L, 2, &coalesce, &siginfo);
+	check_handler_order(L, 2, coalesce, &priority, &urgent);
+	signal_options opts;
+	check_signal_options(L, 2, &opts);
+
+	// validate everything up front, nothing is changed on bad input
+	int signums[ELI_SIGNAL_MAX];
+	int count = 0;
+	lua_pushnil(L);
+	while (lua_next(L, 1) != 0) {
+		int signum = (int)lua_tointeger(L, -2);
+		luaL_argcheck(L, lua_isinteger(L, -2) && signum > 0 &&
+					 signum < ELI_SIGNAL_MAX,
+			      1, "invalid signal");
+		luaL_argcheck(L, lua_isfunction(L, -1), 1,
+			      "handler must be a function");
+		signums[count++] = signum;
+		lua_pop(L, 1);
+	}
+
+#ifdef LUA_USE_POSIX
+	sigset_t old_mask;
+	signal_block_batch(signums, count, &old_mask);
+#endif
+	for (int i = 0; i < count; i++) {
+		st->coalesce[signums[i]] = coalesce;
+		st->siginfo[signums[i]] = siginfo;
+		st->urgent[signums[i]] = urgent;
+		lua_rawgeti(L, 1, signums[i]);
+		add_handler_entry(L, st, signums[i], -1, priority, 1);
+		lua_pop(L, 1);
+		if (siginfo) {
+			ensure_info_table(L, st, signums[i]);
+		}
+	}
+
+	int res = 0, err = 0;
+	signal_registry_acquire();
+	for (int i = 0; i < count; i++) {
+		res = signal_subscribe_locked(st, signums[i], &opts);
+		if (res != 0) {
+			err = errno;
+			break;
+		}
+	}
+	if (res != 0) {
+		for (int i = 0; i < count; i++) {
+			signal_unsubscribe_locked(st, signums[i]);
+			signal_clear_mode(st, signums[i]);
+		}
+	}
+	signal_registry_release();
+	if (res != 0) {
+		for (int i = 0; i < count; i++) {
+			clear_handler_entries(L, st, signums[i]);
+		}
+	}
+#ifdef LUA_USE_POSIX
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+#endif
+
+	if (res != 0) {
+		errno = err;
+		return push_error(L, "failed to set signal handlers");
+	}
+	return 0;
+}
+
+/*
+---#DES 'signal.reset_many'
+---
+---Resets handlers of all listed signals in one pass with the signals
+---blocked meanwhile, see signal.handle_many.
+---Returns nil, error desc and errno on failure.
+---@param signums integer[]
+*/
+static int eli_os_signal_reset_many(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int signums[ELI_SIGNAL_MAX];
+	int count = (int)lua_rawlen(L, 1);
+	luaL_argcheck(L, count < ELI_SIGNAL_MAX, 1, "too many signals");
+	for (int i = 0; i < count; i++) {
+		lua_rawgeti(L, 1, i + 1);
+		int signum = (int)lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+			      "invalid signal");
+		signums[i] = signum;
+	}
+
+#ifdef LUA_USE_POSIX
+	sigset_t old_mask;
+	signal_block_batch(signums, count, &old_mask);
+#endif
+	int res = 0, err = 0;
+	signal_registry_acquire();
+	for (int i = 0; i < count; i++) {
+		if (signal_unsubscribe_locked(st, signums[i]) != 0 && res == 0) {
+			res = -1;
+			err = errno;
+		}
+		signal_clear_mode(st, signums[i]);
+	}
+	signal_registry_release();
+#ifdef LUA_USE_POSIX
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+#endif
+	for (int i = 0; i < count; i++) {
+		clear_handler_entries(L, st, signums[i]);
+		clear_waiters(L, st, signums[i]);
+	}
+
+	if (res != 0) {
+		errno = err;
+		return push_error(L, "failed to reset signal handlers");
+	}
+	return 0;
+}
+
+static int handlers_view_newindex(lua_State *L)
+{
+	return luaL_error(L, "signal handlers view is read-only");
+}
+
+// iterates snapshot held as upvalue, the proxy is passed as state so the
+// snapshot itself never reaches lua code
+static int handlers_view_next(lua_State *L)
+{
+	lua_settop(L, 2);
+	if (lua_next(L, lua_upvalueindex(1)) != 0) {
+		return 2;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+static int handlers_view_pairs(lua_State *L)
+{
+	lua_getmetatable(L, 1);
+	lua_getfield(L, -1, "__index");
+	lua_pushcclosure(L, handlers_view_next, 1);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
+}
+
+static int handlers_view_len(lua_State *L)
+{
+	lua_getmetatable(L, 1);
+	lua_getfield(L, -1, "__index");
+	lua_pushinteger(L, (lua_Integer)lua_rawlen(L, -1));
+	return 1;
+}
+
+// pushes read-only proxy of signum -> first (highest priority) handler
+static void push_handlers_view(lua_State *L, signal_state *st)
+{
+	lua_newtable(L); // proxy
+	lua_createtable(L, 0, 4); // metatable
+	lua_newtable(L); // snapshot
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersRef);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		lua_rawgeti(L, -1, 1);
+		lua_rawgeti(L, -1, SIGNAL_HANDLER_FN);
+		lua_pushvalue(L, -4); // signum
+		lua_insert(L, -2);
+		lua_rawset(L, -7);
+		lua_pop(L, 2);
+	}
+	lua_pop(L, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, handlers_view_newindex);
+	lua_setfield(L, -2, "__newindex");
+	lua_pushcfunction(L, handlers_view_pairs);
+	lua_setfield(L, -2, "__pairs");
+	lua_pushcfunction(L, handlers_view_len);
+	lua_setfield(L, -2, "__len");
+	lua_pushboolean(L, 0);
+	lua_setfield(L, -2, "__metatable");
+	lua_setmetatable(L, -2);
+}
+
+/*
+---#DES 'signal.handlers'
+---
+---Returns read-only view of signum -> handler, the first (highest
+---priority) one for signals with more handlers. The view is cached and
+---only rebuilt after handlers change; iterate it with pairs.
+---@return table<integer, function>
+*/
+static int eli_os_signal_handlers(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	if (st->handlersViewRef != LUA_NOREF &&
+	    st->handlers_view_version == st->handlers_version) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, st->handlersViewRef);
+		return 1;
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, st->handlersViewRef);
+	push_handlers_view(L, st);
+	lua_pushvalue(L, -1);
+	st->handlersViewRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	st->handlers_view_version = st->handlers_version;
+	return 1;
+}
+
+/*
+---#DES 'signal.is_handled'
+---
+---Returns true if the current lua state handles signum.
+---@param signum integer
+---@return boolean
+*/
+static int eli_os_signal_is_handled(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int signum = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+		      "invalid signal");
+	lua_pushboolean(L, st->handled[signum] != 0);
+	return 1;
+}
+
+/*
+---#DES 'signal.raise'
+---
+---Sends signal to the current process. With `value` (posix) the signal is
+---queued with sigqueue and value is delivered to siginfo handlers.
+---@param signum integer
+---@param value integer?
+*/
+static int eli_os_signal_raise(lua_State *L)
+{
+	int signum = luaL_checkinteger(L, 1);
+#if defined(LUA_USE_POSIX) && !defined(__APPLE__)
+	if (!lua_isnoneornil(L, 2)) {
+		union sigval value;
+		value.sival_int = (int)luaL_checkinteger(L, 2);
+		sigqueue(getpid(), signum, value);
+		return 0;
+	}
+#endif
+	raise(signum);
+	return 0;
+}
+
+/*
+---#DES 'signal.queue'
+---
+---Queues signal with integer payload to process `pid` (sigqueue). Real-time
+---signals are delivered in order and are not merged.
+---Returns true on success, otherwise nil, error desc and errno.
+---@param pid integer
+---@param signum integer
+---@param value integer?
+---@return boolean?, string?, integer?
+*/
+static int eli_os_signal_queue(lua_State *L)
+{
+#if defined(LUA_USE_POSIX) && !defined(__APPLE__)
+	pid_t pid = (pid_t)luaL_checkinteger(L, 1);
+	int signum = (int)luaL_checkinteger(L, 2);
+	union sigval value;
+	value.sival_int = (int)luaL_optinteger(L, 3, 0);
+	if (sigqueue(pid, signum, value) == -1) {
+		return push_error(L, "failed to queue signal");
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+#else
+	lua_pushnil(L);
+	lua_pushstring(L, "sigqueue not supported on this platform");
+	return 2;
+#endif
+}
+
+/*
+** Children watched through signal.watch_child. On linux every child has a
+** pidfd polled by a single watcher thread, on windows a thread pool wait is
+** registered on the process handle. Exits are reaped and queued as SIGCHLD
+** events with pid/status/code info to the watching state.
+*/
+typedef struct child_watch {
+	struct child_watch *next;
+	signal_state *st;
+	lua_Integer pid;
+#if defined(ELI_CHILD_WATCH_PIDFD)
+	int pidfd;
+	unsigned long id; // tells apart watches reusing freed memory
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+	HANDLE process;
+	HANDLE wait;
+#endif
+} child_watch;
+
+#if defined(ELI_CHILD_WATCH_PIDFD) || defined(ELI_CHILD_WATCH_HANDLE)
+static child_watch *child_watches = NULL;
+#endif
+#if defined(ELI_CHILD_WATCH_PIDFD)
+static pthread_mutex_t child_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int child_watch_wake_fd = -1; // eventfd, watcher runs once set
+static unsigned long child_watch_next_id = 0;
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+static SRWLOCK child_watch_lock = SRWLOCK_INIT;
+#endif
+
+#if defined(ELI_CHILD_WATCH_PIDFD) || defined(ELI_CHILD_WATCH_HANDLE)
+static void child_watch_acquire(void)
+{
+#if defined(ELI_CHILD_WATCH_PIDFD)
+	pthread_mutex_lock(&child_watch_lock);
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+	AcquireSRWLockExclusive(&child_watch_lock);
+#endif
+}
+
+static void child_watch_unlock(void)
+{
+#if defined(ELI_CHILD_WATCH_PIDFD)
+	pthread_mutex_unlock(&child_watch_lock);
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+	ReleaseSRWLockExclusive(&child_watch_lock);
+#endif
+}
+
+#if defined(ELI_CHILD_WATCH_HANDLE)
+// removes watch from the list, returns 0 if it was not there (lock held)
+static int child_watch_unlink(child_watch *watch)
+{
+	for (child_watch **it = &child_watches; *it != NULL;
+	     it = &(*it)->next) {
+		if (*it == watch) {
+			*it = watch->next;
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
+static void child_exit_push(child_watch *watch, int status, int code)
+{
+	signal_event event;
+	memset(&event, 0, sizeof(event));
+	event.signum = SIGCHLD;
+	event.has_info = 1;
+	event.info.pid = (int)watch->pid;
+	event.info.status = status;
+	event.info.code = code;
+	event.time = eli_monotonic_ns();
+	signal_state_push_child(watch->st, &event);
+}
+#endif
+
+#if defined(ELI_CHILD_WATCH_PIDFD)
+static void child_watch_wake(void)
+{
+	uint64_t one = 1;
+	ssize_t res = write(child_watch_wake_fd, &one, sizeof(one));
+	(void)res;
+}
+
+// polled watch and its id, the watch may be released while polling
+typedef struct child_watch_ref {
+	child_watch *watch;
+	unsigned long id;
+} child_watch_ref;
+
+static void child_watch_reap(const child_watch_ref *ref)
+{
+	child_watch_acquire();
+	// only listed watches may be dereferenced
+	child_watch **it = &child_watches;
+	while (*it != NULL && (*it != ref->watch || (*it)->id != ref->id)) {
+		it = &(*it)->next;
+	}
+	child_watch *watch = *it;
+	if (watch != NULL) {
+		*it = watch->next;
+	}
+	child_watch_unlock();
+	if (watch == NULL) {
+		return; // released meanwhile
+	}
+	siginfo_t info;
+	memset(&info, 0, sizeof(info));
+	int status = 0, code = 0;
+	// foreign processes can not be reaped, their status stays unknown
+	if (waitid(P_PID, (id_t)watch->pid, &info, WEXITED | WNOHANG) == 0 &&
+	    info.si_pid != 0) {
+		status = info.si_status;
+		code = info.si_code;
+	}
+	close(watch->pidfd);
+	child_exit_push(watch, status, code);
+	free(watch);
+}
+
+static void *child_watch_main(void *arg)
+{
+	(void)arg;
+	struct pollfd *fds = NULL;
+	child_watch_ref *refs = NULL;
+	size_t capacity = 0;
+	for (;;) {
+		child_watch_acquire();
+		size_t count = 1;
+		for (child_watch *it = child_watches; it != NULL; it = it->next) {
+			count++;
+		}
+		if (count > capacity) {
+			struct pollfd *grown =
+				realloc(fds, count * 2 * sizeof(struct pollfd));
+			if (grown != NULL) {
+				fds = grown;
+			}
+			child_watch_ref *grown_refs = realloc(
+				refs, count * 2 * sizeof(child_watch_ref));
+			if (grown_refs != NULL) {
+				refs = grown_refs;
+			}
+			if (grown == NULL || grown_refs == NULL) {
+				child_watch_unlock();
+				eli_sleep_ns(10000000);
+				continue;
+			}
+			capacity = count * 2;
+		}
+		fds[0].fd = child_watch_wake_fd;
+		fds[0].events = POLLIN;
+		size_t n = 1;
+		for (child_watch *it = child_watches; it != NULL; it = it->next) {
+			fds[n].fd = it->pidfd;
+			fds[n].events = POLLIN;
+			refs[n].watch = it;
+			refs[n].id = it->id;
+			n++;
+		}
+		child_watch_unlock();
+
+		if (poll(fds, n, -1) == -1) {
+			continue;
+		}
+		if (fds[0].revents != 0) {
+			uint64_t value;
+			ssize_t res = read(child_watch_wake_fd, &value,
+					   sizeof(value));
+			(void)res;
+		}
+		for (size_t i = 1; i < n; i++) {
+			if (fds[i].revents & (POLLIN | POLLHUP)) {
+				child_watch_reap(&refs[i]);
+			}
+		}
+	}
+	return NULL;
+}
+
+// starts watcher thread unless running, called with lock held
+static int child_watch_start(void)
+{
+	if (child_watch_wake_fd != -1) {
+		return 0;
+	}
+	int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fd == -1) {
+		return -1;
+	}
+	child_watch_wake_fd = fd;
+	// watcher must not take process signals
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int err = pthread_create(&thread, &attr, child_watch_main, NULL);
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		close(fd);
+		child_watch_wake_fd = -1;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+static VOID CALLBACK child_exit_callback(PVOID context, BOOLEAN timed_out)
+{
+	(void)timed_out;
+	child_watch *watch = (child_watch *)context;
+	child_watch_acquire();
+	int owned = child_watch_unlink(watch);
+	child_watch_unlock();
+	if (!owned) {
+		return; // released meanwhile, releaser cleans up
+	}
+	DWORD exit_code = 0;
+	GetExitCodeProcess(watch->process, &exit_code);
+	UnregisterWait(watch->wait);
+	CloseHandle(watch->process);
+	child_exit_push(watch, (int)exit_code, CLD_EXITED);
+	free(watch);
+}
+#endif
+
+// stops watching pid (or all children with `all`) of st,
+// returns number of released watches
+static int child_watch_release(signal_state *st, lua_Integer pid, int all)
+{
+#if defined(ELI_CHILD_WATCH_PIDFD) || defined(ELI_CHILD_WATCH_HANDLE)
+	child_watch *released = NULL;
+	child_watch_acquire();
+	for (child_watch **it = &child_watches; *it != NULL;) {
+		child_watch *watch = *it;
+		if (watch->st == st && (all || watch->pid == pid)) {
+			*it = watch->next;
+			watch->next = released;
+			released = watch;
+		} else {
+			it = &watch->next;
+		}
+	}
+	child_watch_unlock();
+	int count = 0;
+	while (released != NULL) {
+		child_watch *watch = released;
+		released = watch->next;
+#if defined(ELI_CHILD_WATCH_PIDFD)
+		close(watch->pidfd);
+#else
+		// waits for a callback which might be running
+		UnregisterWaitEx(watch->wait, INVALID_HANDLE_VALUE);
+		CloseHandle(watch->process);
+#endif
+		free(watch);
+		count++;
+	}
+#if defined(ELI_CHILD_WATCH_PIDFD)
+	if (count > 0) {
+		child_watch_wake();
+	}
+#endif
+	return count;
+#else
+	(void)st;
+	(void)pid;
+	(void)all;
+	return 0;
+#endif
+}
+
+#if defined(ELI_CHILD_WATCH_PIDFD) || defined(ELI_CHILD_WATCH_HANDLE)
+#define CHILD_HANDLE_METATABLE "ELI_OS_CHILD_HANDLE"
+
+// caller side duplicate of the watched pidfd/process handle, the watcher
+// closes its own one at any time
+typedef struct child_handle {
+#ifdef ELI_CHILD_WATCH_HANDLE
+	HANDLE process;
+#else
+	int fd;
+#endif
+	int closed;
+} child_handle;
+
+/*
+---#DES 'EliOsChildHandle:fd'
+---
+---Returns pollable object readable once the child exited - pidfd or
+---process HANDLE (light userdata) on windows. Stays valid after the exit
+---until the child handle is closed.
+---@param self EliOsChildHandle
+---@return integer|lightuserdata
+*/
+static int child_handle_fd(lua_State *L)
+{
+	child_handle *handle =
+		(child_handle *)luaL_checkudata(L, 1, CHILD_HANDLE_METATABLE);
+	luaL_argcheck(L, !handle->closed, 1, "child handle is closed");
+#ifdef ELI_CHILD_WATCH_HANDLE
+	lua_pushlightuserdata(L, handle->process);
+#else
+	lua_pushinteger(L, handle->fd);
+#endif
+	return 1;
+}
+
+/*
+---#DES 'EliOsChildHandle:close'
+---
+---Closes the pollable object, the child stays watched.
+---@param self EliOsChildHandle
+*/
+static int child_handle_gc(lua_State *L)
+{
+	child_handle *handle =
+		(child_handle *)luaL_checkudata(L, 1, CHILD_HANDLE_METATABLE);
+	if (handle->closed) {
+		return 0;
+	}
+	handle->closed = 1;
+#ifdef ELI_CHILD_WATCH_HANDLE
+	CloseHandle(handle->process);
+#else
+	close(handle->fd);
+#endif
+	return 0;
+}
+
+static const struct luaL_Reg childHandleMethods[] = {
+	{ "fd", child_handle_fd },
+	{ "close", child_handle_gc },
+	{ NULL, NULL },
+};
+
+// pushed before anything is acquired, so a memory error leaks nothing
+static child_handle *push_child_handle(lua_State *L)
+{
+	child_handle *handle = (child_handle *)lua_newuserdatauv(
+		L, sizeof(child_handle), 0);
+	handle->closed = 1; /* until owned, nothing to release in __gc */
+	if (luaL_newmetatable(L, CHILD_HANDLE_METATABLE)) {
+		lua_newtable(L);
+		luaL_setfuncs(L, childHandleMethods, 0);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, child_handle_gc);
+		lua_setfield(L, -2, "__gc");
+		lua_pushcfunction(L, child_handle_gc);
+		lua_setfield(L, -2, "__close");
+	}
+	lua_setmetatable(L, -2);
+	return handle;
+}
+#endif
+
+/*
+---#DES 'signal.watch_child'
+---
+---Watches child process `pid`. Once it exits, the child is reaped and a
+---SIGCHLD event is queued to this lua state and dispatched to SIGCHLD
+---handlers with info table (pid, status, code) as third argument, same as
+---siginfo handlers. SIGCHLD itself does not need to be handled.
+---While SIGCHLD is handled on posix, the kernel signal is delivered as
+---well, so handlers see an exit of a watched child twice: once from the
+---kernel (info only with `siginfo`) and once from the watch, with exit
+---status. Tell them apart by pid if needed and do not reap watched
+---children in handlers, the watch would not get their status.
+---Returns child handle whose `fd()` is pollable on exit - pidfd (linux
+---5.3+) or process HANDLE on windows. It is closed with `close()`, when
+---collected or as to-be-closed variable; the watch is not affected.
+---Returns nil, error desc and errno on failure.
+---@param pid integer
+---@return EliOsChildHandle?, string?, integer?
+*/
+static int eli_os_signal_watch_child(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	lua_Integer pid = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, pid > 0, 1, "invalid pid");
+#if defined(ELI_CHILD_WATCH_PIDFD)
+	child_handle *handle = push_child_handle(L);
+	int pidfd = (int)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+	if (pidfd == -1) {
+		return push_error(L, "failed to watch child");
+	}
+	// watcher closes its pidfd at any time, caller gets its own
+	int own = fcntl(pidfd, F_DUPFD_CLOEXEC, 0);
+	child_watch *watch = own == -1 ? NULL : malloc(sizeof(child_watch));
+	if (watch == NULL) {
+		int err = own == -1 ? errno : ENOMEM;
+		close(pidfd);
+		if (own != -1) {
+			close(own);
+		}
+		errno = err;
+		return push_error(L, "failed to watch child");
+	}
+	watch->st = st;
+	watch->pid = pid;
+	watch->pidfd = pidfd;
+	child_watch_acquire();
+	if (child_watch_start() != 0) {
+		int err = errno;
+		child_watch_unlock();
+		close(pidfd);
+		close(own);
+		free(watch);
+		errno = err;
+		return push_error(L, "failed to start child watcher");
+	}
+	watch->id = ++child_watch_next_id;
+	watch->next = child_watches;
+	child_watches = watch;
+	child_watch_unlock();
+	child_watch_wake();
+	handle->fd = own;
+	handle->closed = 0;
+	return 1;
+#elif defined(ELI_CHILD_WATCH_HANDLE)
+	child_handle *handle = push_child_handle(L);
+	HANDLE process =
+		OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION,
+			    FALSE, (DWORD)pid);
+	if (process == NULL) {
+		errno = GetLastError() == ERROR_ACCESS_DENIED ? EPERM : ESRCH;
+		return push_error(L, "failed to watch child");
+	}
+	// watcher closes its handle at any time, caller gets its own
+	HANDLE own = NULL;
+	if (!DuplicateHandle(GetCurrentProcess(), process,
+			     GetCurrentProcess(), &own, 0, FALSE,
+			     DUPLICATE_SAME_ACCESS)) {
+		CloseHandle(process);
+		errno = EINVAL;
+		return push_error(L, "failed to watch child");
+	}
+	child_watch *watch = malloc(sizeof(child_watch));
+	if (watch == NULL) {
+		CloseHandle(process);
+		CloseHandle(own);
+		errno = ENOMEM;
+		return push_error(L, "failed to watch child");
+	}
+	watch->st = st;
+	watch->pid = pid;
+	watch->process = process;
+	// callback waits for the lock, so it sees watch->wait assigned
+	child_watch_acquire();
+	watch->next = child_watches;
+	child_watches = watch;
+	if (!RegisterWaitForSingleObject(&watch->wait, process,
+					 child_exit_callback, watch, INFINITE,
+					 WT_EXECUTEONLYONCE)) {
+		child_watch_unlink(watch);
+		child_watch_unlock();
+		CloseHandle(process);
+		CloseHandle(own);
+		free(watch);
+		errno = EINVAL;
+		return push_error(L, "failed to watch child");
+	}
+	child_watch_unlock();
+	handle->process = own;
+	handle->closed = 0;
+	return 1;
+#else
+	(void)st;
+	(void)pid;
+	lua_pushnil(L);
+	lua_pushstring(L, "watch_child not supported on this platform");
+	return 2;
+#endif
+}
+
+/*
+---#DES 'signal.unwatch_child'
+---
+---Stops watching child `pid`. The child handle returned by
+---signal.watch_child is owned by the caller and stays open.
+---Returns true if the child was watched, false otherwise.
+---@param pid integer
+---@return boolean
+*/
+static int eli_os_signal_unwatch_child(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	lua_Integer pid = luaL_checkinteger(L, 1);
+	lua_pushboolean(L, child_watch_release(st, pid, 0) > 0);
+	return 1;
+}
+
+// sends signum to pid, optionally with sigqueue payload,
+// returns 0 on success (errno set otherwise)
+static int send_signal(lua_Integer pid, int signum, int has_value, int value)
+{
+	if (pid <= 0) {
+		// kill would signal a group or every process, see send_group
+		errno = EINVAL;
+		return -1;
+	}
+#ifdef _WIN32
+	(void)has_value;
+	(void)value;
+	// no signals between processes, termination is all we can map
+	if (signum != SIGTERM && signum != SIGKILL) {
+		errno = EINVAL;
+		return -1;
+	}
+	HANDLE process = OpenProcess(PROCESS_TERMINATE, FALSE, (DWORD)pid);
+	if (process == NULL) {
+		errno = GetLastError() == ERROR_ACCESS_DENIED ? EPERM : ESRCH;
+		return -1;
+	}
+	BOOL ok = TerminateProcess(process, 128 + signum);
+	CloseHandle(process);
+	if (!ok) {
+		errno = EPERM;
+		return -1;
+	}
+	return 0;
+#elif defined(LUA_USE_POSIX)
+#ifdef ELI_CHILD_WATCH_PIDFD
+	// watched children hold a pidfd, which can not be misrouted to a
+	// process reusing the pid
+	child_watch_acquire();
+	child_watch *watch = child_watches;
+	while (watch != NULL && watch->pid != pid) {
+		watch = watch->next;
+	}
+	if (watch != NULL) {
+		siginfo_t info;
+		memset(&info, 0, sizeof(info));
+		info.si_signo = signum;
+		info.si_code = SI_QUEUE;
+		info.si_pid = getpid();
+		info.si_uid = getuid();
+		info.si_value.sival_int = value;
+		long res = syscall(SYS_pidfd_send_signal, watch->pidfd, signum,
+				   has_value ? &info : NULL, 0);
+		int err = errno;
+		child_watch_unlock();
+		if (res == 0 || err != ENOSYS) {
+			errno = err;
+			return res == 0 ? 0 : -1;
+		}
+	} else {
+		child_watch_unlock();
+	}
+#endif
+#ifndef __APPLE__
+	if (has_value) {
+		union sigval sv;
+		sv.sival_int = value;
+		return sigqueue((pid_t)pid, signum, sv);
+	}
+#else
+	(void)has_value;
+	(void)value;
+#endif
+	return kill((pid_t)pid, signum);
+#else
+	(void)pid;
+	(void)signum;
+	(void)has_value;
+	(void)value;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+---#DES 'signal.send'
+---
+---Sends signal to process `pid` or to every pid of the list in a single
+---call. With `value` (posix, except macos) signals are queued with
+---sigqueue and value is delivered to siginfo handlers.
+---On windows only SIGTERM and SIGKILL are supported (process terminates).
+---Pids must be positive (EINVAL otherwise), use signal.send_group for
+---process groups.
+---Returns true if signal was delivered to all processes, otherwise nil,
+---error desc, errno of the first failure and table of pid -> errno.
+---@param pid_or_list integer|integer[]
+---@param signum integer
+---@param value integer?
+---@return boolean?, string?, integer?, table<integer, integer>?
+*/
+static int eli_os_signal_send(lua_State *L)
+{
+	int signum = (int)luaL_checkinteger(L, 2);
+	int has_value = !lua_isnoneornil(L, 3);
+	int value = has_value ? (int)luaL_checkinteger(L, 3) : 0;
+	if (!lua_istable(L, 1)) {
+		if (send_signal(luaL_checkinteger(L, 1), signum, has_value,
+				value) != 0) {
+			return push_error(L, "failed to send signal");
+		}
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	lua_Integer count = (lua_Integer)lua_rawlen(L, 1);
+	lua_Integer failed = 0;
+	int first_errno = 0;
+	for (lua_Integer i = 1; i <= count; i++) {
+		lua_rawgeti(L, 1, i);
+		int isnum;
+		lua_Integer pid = lua_tointegerx(L, -1, &isnum);
+		lua_pop(L, 1);
+		luaL_argcheck(L, isnum, 1, "list of pids expected");
+		if (send_signal(pid, signum, has_value, value) == 0) {
+			continue;
+		}
+		int err = errno;
+		if (failed++ == 0) {
+			first_errno = err;
+			lua_newtable(L);
+		}
+		lua_pushinteger(L, err);
+		lua_rawseti(L, -2, pid);
+	}
+	if (failed == 0) {
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	lua_pushnil(L);
+	lua_pushfstring(L, "failed to send signal to %d of %d processes",
+			(int)failed, (int)count);
+	lua_pushinteger(L, first_errno);
+	lua_rotate(L, -4, -1); // failures table last
+	return 4;
+}
+
+/*
+---#DES 'signal.send_group'
+---
+---Sends signal to every process of process group `pgid` (killpg).
+---On windows only SIGINT and SIGBREAK are supported and are sent as
+---console control events to the group.
+---Returns true on success, otherwise nil, error desc and errno.
+---@param pgid integer
+---@param signum integer
+---@return boolean?, string?, integer?
+*/
+static int eli_os_signal_send_group(lua_State *L)
+{
+	lua_Integer pgid = luaL_checkinteger(L, 1);
+	int signum = (int)luaL_checkinteger(L, 2);
+#ifdef _WIN32
+	if (signum != SIGINT && signum != SIGBREAK) {
+		errno = EINVAL;
+		return push_error(L, "failed to send signal to group");
+	}
+	if (!GenerateConsoleCtrlEvent(signum == SIGINT ? CTRL_C_EVENT :
+							 CTRL_BREAK_EVENT,
+				      (DWORD)pgid)) {
+		errno = EINVAL;
+		return push_error(L, "failed to send signal to group");
+	}
+#elif defined(LUA_USE_POSIX)
+	if (killpg((pid_t)pgid, signum) == -1) {
+		return push_error(L, "failed to send signal to group");
+	}
+#else
+	(void)pgid;
+	(void)signum;
+	lua_pushnil(L);
+	lua_pushstring(L, "killpg not supported on this platform");
+	return 2;
+#endif
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+---#DES 'signal.set_dispatch'
+---
+---Selects how queued signals are dispatched to handlers of this lua state:
+--- - "hook" - hook armed to run handlers on next instruction (default)
+--- - "count" - count hook only, handlers run after `count` instructions
+--- - "poll" - no hook at all, handlers run from `signal.dispatch()`
+---@param mode '"hook"' | '"count"' | '"poll"'
+---@param count integer?
+*/
+static int eli_os_signal_set_dispatch(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	static const char *const modes[] = { "hook", "count", "poll", NULL };
+	int mode = luaL_checkoption(L, 1, "hook", modes);
+	int count = (int)luaL_optinteger(L, 2, mode == SIGNAL_DISPATCH_COUNT ?
+							  1000 :
+							  1);
+	luaL_argcheck(L, count > 0, 2, "count must be positive");
+
+	switch (mode) {
+	case SIGNAL_DISPATCH_HOOK:
+		st->dispatch_hook_mask = LUA_MASKCALL | LUA_MASKRET |
+					 LUA_MASKLINE | LUA_MASKCOUNT;
+		break;
+	default:
+		st->dispatch_hook_mask = LUA_MASKCOUNT;
+		break;
+	}
+	st->dispatch_hook_count = count;
+	st->dispatch_mode = mode;
+	if (mode == SIGNAL_DISPATCH_POLL) {
+		disarm_lua_callback(st); /* drop hook which might be armed */
+	} else {
+		disarm_lua_callback(st); /* hook armed with previous mode */
+		arm_lua_callback(st); /* pick up signals queued while polling */
+	}
+	return 0;
+}
+
+/*
+---#DES 'signal.await'
+---
+---Parks the running coroutine until signum is delivered. Yields signum to
+---the scheduler, which should not resume the coroutine itself; it is
+---resumed by signal.dispatch once the signal arrived and await returns
+---signum, ctrl_event and occurrence count or info table like handler
+---arguments. Handlers of the signal (if any) run as well.
+---If the signal is not handled yet, it gets subscribed with sigaction
+---`options` (restart, mask, nodefer, resethand, onstack - see
+---signal.handle) and stays subscribed after the wakeup, so awaiting in a
+---loop does not miss deliveries, until signal.reset or signal.reset_many,
+---which also drop parked coroutines without resuming them.
+---Returns nil, error desc and errno on failure.
+---@param signum integer
+---@param options { restart: boolean?, mask: integer[]?, nodefer: boolean?, resethand: boolean?, onstack: boolean? }?
+---@return integer?, integer|false|string?, integer|table?
+*/
+static int eli_os_signal_await(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int signum = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+		      "invalid signal");
+	if (!lua_isyieldable(L)) {
+		return luaL_error(L, "signal.await outside of a coroutine");
+	}
+	if (!st->handled[signum]) {
+		signal_options opts;
+		check_signal_options(L, 2, &opts);
+		if (signal_subscribe(st, signum, &opts) != 0) {
+			return push_error(L, "failed to await signal");
+		}
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->waitersRef);
+	if (lua_rawgeti(L, -1, signum) != LUA_TTABLE) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, signum);
+	}
+	lua_pushthread(L);
+	lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+	lua_pop(L, 2);
+	st->waiting[signum]++;
+	lua_settop(L, 1);
+	return lua_yield(L, 1);
+}
+
+// resumes coroutines woken by signals, through `resume` function at idx
+// if set, returns number of resumed coroutines
+// error object on top of `from`, reported the same way as handler errors
+static void report_waiter_error(lua_State *from, signal_counters *stats)
+{
+	stats->errors++;
+	lua_writestringerror("error resuming signal waiter: %s\n",
+			     lua_tostring(from, -1));
+	lua_pop(from, 1);
+}
+
+static int resume_waiters(lua_State *L, signal_state *st, int resume)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, st->readyRef);
+	lua_Integer n = (lua_Integer)lua_rawlen(L, -1);
+	if (n == 0) {
+		lua_pop(L, 1);
+		return 0;
+	}
+	// coroutines awaiting again while resumed go to a fresh list
+	lua_newtable(L);
+	luaL_unref(L, LUA_REGISTRYINDEX, st->readyRef);
+	st->readyRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	int ready = lua_gettop(L);
+	for (lua_Integer i = 1; i <= n; i++) {
+		lua_rawgeti(L, ready, i);
+		int entry = lua_gettop(L);
+		lua_rawgeti(L, entry, 2);
+		signal_counters *stats = &st->stats[lua_tointeger(L, -1)];
+		lua_pop(L, 1);
+		if (resume) {
+			lua_pushvalue(L, resume);
+			for (int field = 1; field <= 4; field++) {
+				lua_rawgeti(L, entry, field);
+			}
+			// protected, remaining entries of the list must not be lost
+			if (lua_pcall(L, 4, 0, 0) != LUA_OK) {
+				report_waiter_error(L, stats);
+			}
+		} else {
+			lua_rawgeti(L, entry, 1);
+			lua_State *co = lua_tothread(L, -1);
+			int nargs = 2;
+			lua_rawgeti(L, entry, 2);
+			lua_rawgeti(L, entry, 3);
+			if (lua_rawgeti(L, entry, 4) == LUA_TNIL) {
+				lua_pop(L, 1);
+			} else {
+				nargs++;
+			}
+			lua_xmove(L, co, nargs);
+			int nres;
+			int status = lua_resume(co, L, nargs, &nres);
+			if (status == LUA_OK || status == LUA_YIELD) {
+				lua_pop(co, nres);
+			} else {
+				report_waiter_error(co, stats);
+			}
+		}
+		lua_settop(L, ready);
+	}
+	lua_pop(L, 1);
+	return (int)n;
+}
+
+/*
+---#DES 'signal.dispatch'
+---
+---Runs handlers of queued signals and resumes coroutines parked by
+---signal.await. Meant to be called from event loop at safe points in
+---"poll" dispatch mode; with "hook" and "count" modes handlers run on the
+---main thread only, awaiting coroutines are resumed only here.
+---With `resume` set, woken coroutines are passed to it together with the
+---values await returns - resume(co, signum, ctrl_event, count_or_info) -
+---instead of being resumed directly.
+---Errors raised by resumed coroutines or by `resume` are reported like
+---handler errors (stderr and `errors` of signal.stats).
+---Returns number of dispatched signals and number of resumed coroutines.
+---@param resume fun(co: thread, signum: integer, ctrl_event: integer|false, count_or_info: integer|table?)?
+---@return integer, integer
+*/
+static int eli_os_signal_dispatch(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int resume = 0;
+	if (!lua_isnoneornil(L, 1)) {
+		luaL_checktype(L, 1, LUA_TFUNCTION);
+		resume = 1;
+	}
+	lua_pushinteger(L, dispatch_signals(L, st));
+	lua_pushinteger(L, resume_waiters(L, st, resume));
+	return 2;
+}
+
+// enters signal.block level, returns 0 on success (errno set otherwise)
+static int signal_block(signal_state *st, int mask)
+{
+#ifdef LUA_USE_POSIX
+	if (mask && st->defer_mask_depth == 0) {
+		sigset_t set;
+		sigemptyset(&set);
+		for (int signum = 1; signum < ELI_SIGNAL_MAX; signum++) {
+			if (st->handled[signum]) {
+				sigaddset(&set, signum);
+			}
+		}
+		int err = pthread_sigmask(SIG_BLOCK, &set, &st->defer_old_mask);
+		if (err != 0) {
+			errno = err;
+			return -1;
+		}
+		st->defer_mask_depth = st->defer_depth + 1;
+	}
+#else
+	(void)mask;
+#endif
+	st->defer_depth++;
+	return 0;
+}
+
+/*
+---#DES 'signal.block'
+---
+---Defers dispatch of signals in this lua state until matching
+---signal.unblock. Delivered signals are queued (or coalesced) as usual,
+---but the hook is not armed, so no handler interrupts the region. Blocks
+---nest. With `mask` set (posix only), signals handled by the state are
+---also blocked by pthread_sigmask in the calling thread until the block
+---ends, so they do not even interrupt the thread; they are delivered once
+---unblocked.
+---Returns nesting depth, nil, error desc and errno on failure.
+---@param mask boolean?
+---@return integer?, string?, integer?
+*/
+static int eli_os_signal_block(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	if (signal_block(st, lua_toboolean(L, 1)) != 0) {
+		return push_error(L, "failed to block signals");
+	}
+	lua_pushinteger(L, st->defer_depth);
+	return 1;
+}
+
+// leaves one signal.block level, dispatches deferred signals once the
+// outermost one ends
+static void signal_unblock(lua_State *L, signal_state *st)
+{
+#ifdef LUA_USE_POSIX
+	if (st->defer_mask_depth == st->defer_depth) {
+		// pending signals get queued right here, before the flush
+		pthread_sigmask(SIG_SETMASK, &st->defer_old_mask, NULL);
+		st->defer_mask_depth = 0;
+	}
+#endif
+	st->defer_depth--;
+	if (st->defer_depth == 0 &&
+	    st->dispatch_mode != SIGNAL_DISPATCH_POLL) {
+		dispatch_signals(L, st);
+	}
+}
+
+/*
+---#DES 'signal.unblock'
+---
+---Ends innermost signal.block. When the outermost block ends, signals
+---deferred meanwhile are dispatched at once (in "poll" mode they stay
+---queued for signal.dispatch).
+---Returns remaining nesting depth.
+---@return integer
+*/
+static int eli_os_signal_unblock(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	if (st->defer_depth == 0) {
+		return luaL_error(L, "signal.unblock without signal.block");
+	}
+	signal_unblock(L, st);
+	lua_pushinteger(L, st->defer_depth);
+	return 1;
+}
+
+/*
+---#DES 'signal.defer'
+---
+---Calls fn with signal dispatch deferred (see signal.block), deferred
+---signals are dispatched once fn returns or fails. Errors of fn are
+---rethrown.
+---Returns results of fn, nil, error desc and errno if block fails.
+---@param fn function
+---@param mask boolean?
+---@return any
+*/
+static int eli_os_signal_defer(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	int mask = lua_toboolean(L, 2);
+	lua_settop(L, 1);
+	if (signal_block(st, mask) != 0) {
+		return push_error(L, "failed to block signals");
+	}
+	int status = lua_pcall(L, 0, LUA_MULTRET, 0);
+	signal_unblock(L, st);
+	if (status != LUA_OK) {
+		return lua_error(L);
+	}
+	return lua_gettop(L);
+}
+
+/*
+---#DES 'signal.fd'
+---
+---Returns pollable object which becomes readable (signalled) whenever a
+---signal is queued - file descriptor on posix, event HANDLE (light userdata)
+---on windows. Switches dispatch to "poll" mode, queued signals are then
+---consumed with `signal.drain()` or `signal.dispatch()`.
+---Every lua state gets its own fd.
+---Returns nil, error desc and errno on failure.
+---@return integer|lightuserdata?, string?, integer?
+*/
+static int eli_os_signal_fd(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	int created = !signal_wakeup_exists(st);
+	if (signal_wakeup_open(st) != 0) {
+		return push_error(L, "failed to create signal fd");
+	}
+	st->dispatch_mode = SIGNAL_DISPATCH_POLL;
+	disarm_lua_callback(st);
+	// signals queued before fd existed would never wake the poller
+	if (created && signal_state_pending(st)) {
+		signal_wakeup(st);
+	}
+#ifdef _WIN32
+	lua_pushlightuserdata(L, st->event);
+#else
+	lua_pushinteger(L, st->wakeup_read_fd);
+#endif
+	return 1;
+}
+
+/*
+---#DES 'signal.drain'
+---
+---Removes up to `max` (default all) queued signals without running their
+---handlers and returns them as array of signums in arrival order.
+---Coalesced signals are reported once.
+---@param max integer?
+---@return integer[]
+*/
+static int eli_os_signal_drain(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	lua_Integer max = luaL_optinteger(L, 1, ELI_SIGNAL_QUEUE_SIZE +
+							ELI_SIGNAL_MAX);
+	luaL_argcheck(L, max > 0, 1, "max must be positive");
+
+	signal_wakeup_clear(st);
+	lua_createtable(L, 8, 0);
+	lua_Integer n = 0;
+	signal_event event;
+	while (n < max && signal_next_event(st, &event)) {
+#ifdef _WIN32
+		// drained ctrl events count as handled for the console handler
+		signal_ctrl_done(event.ctrl_event);
+#endif
+		lua_pushinteger(L, event.signum);
+		lua_rawseti(L, -2, ++n);
+	}
+	for (int word = 0; word < SIGNAL_MASK_WORDS && n < max; word++) {
+		unsigned int bits = atomic_load_explicit(
+			&st->coalesced_mask[word], memory_order_acquire);
+		for (int bit = 0; bits != 0 && n < max; bit++, bits >>= 1) {
+			if ((bits & 1u) == 0) {
+				continue;
+			}
+			int signum = word * 32 + bit;
+			atomic_fetch_and_explicit(&st->coalesced_mask[word],
+						  ~(1u << bit),
+						  memory_order_acq_rel);
+			if (atomic_exchange_explicit(
+				    &st->coalesced_count[signum], 0,
+				    memory_order_acq_rel) == 0) {
+				continue;
+			}
+#ifdef _WIN32
+			signal_ctrl_done(atomic_load_explicit(
+				&st->coalesced_ctrl[signum],
+				memory_order_relaxed));
+#endif
+			lua_pushinteger(L, signum);
+			lua_rawseti(L, -2, ++n);
+		}
+	}
+	if (n == max) {
+		signal_wakeup(st); /* leftovers, keep poller awake */
+	}
+	return 1;
+}
+
+/*
+---#DES 'signal.wait'
+---
+---Blocks until one of signals in `set` arrives or `timeout` (ms) elapses.
+---Waited signals are consumed by the wait, their handlers do not run.
+---Returns signum and info table (pid, uid, code, status, value),
+---nil and "timeout" on timeout or nil, error desc and errno on failure.
+---@param set integer[]
+---@param timeout integer? - ms, nil or negative waits forever
+---@return integer?, table|string?, integer?
+*/
+static int eli_os_signal_wait(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_Integer timeout = luaL_optinteger(L, 2, -1);
+	size_t count = lua_rawlen(L, 1);
+	luaL_argcheck(L, count > 0, 1, "empty signal set");
+#ifdef _WIN32
+	LONG mask = 0;
+	for (size_t i = 1; i <= count; i++) {
+		lua_rawgeti(L, 1, i);
+		int signum = (int)lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		luaL_argcheck(L, signum > 0 && signum < 32, 1,
+			      "invalid signal");
+		mask |= 1L << signum;
+	}
+	if (signal_wait_event == NULL) {
+		signal_wait_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (signal_wait_event == NULL) {
+			return push_error(L, "failed to create wait event");
+		}
+	}
+	// ctrl events are only received while console handler is installed
+	int installed = 0;
+	if (subscribedCtrlEvents == 0) {
+		if (!SetConsoleCtrlHandler(windows_ctrl_handler, TRUE)) {
+			return push_error(L, "failed to set signal handler");
+		}
+		installed = 1;
+	}
+	ResetEvent(signal_wait_event);
+	InterlockedExchange(&signal_wait_mask, mask);
+	DWORD res = WaitForSingleObject(signal_wait_event,
+					timeout < 0 ? INFINITE : (DWORD)timeout);
+	InterlockedExchange(&signal_wait_mask, 0);
+	if (installed) {
+		SetConsoleCtrlHandler(windows_ctrl_handler, FALSE);
+	}
+	if (res == WAIT_TIMEOUT) {
+		lua_pushnil(L);
+		lua_pushstring(L, "timeout");
+		return 2;
+	}
+	if (res != WAIT_OBJECT_0) {
+		return push_error(L, "failed to wait for signal");
+	}
+	lua_pushinteger(L, InterlockedExchange(&signal_wait_signum, 0));
+	lua_createtable(L, 0, 0);
+	return 2;
+#else
+	sigset_t set, old;
+	sigemptyset(&set);
+	for (size_t i = 1; i <= count; i++) {
+		lua_rawgeti(L, 1, i);
+		int signum = (int)lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX, 1,
+			      "invalid signal");
+		sigaddset(&set, signum);
+	}
+	// signals have to be blocked, otherwise they are delivered to handler
+	int mask_err = pthread_sigmask(SIG_BLOCK, &set, &old);
+	if (mask_err != 0) {
+		errno = mask_err;
+		return push_error(L, "failed to block signals");
+	}
+	siginfo_t info;
+	memset(&info, 0, sizeof(info));
+	int signum;
+#ifdef __APPLE__
+	// no sigtimedwait, only blocking wait without payload
+	if (timeout >= 0) {
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		lua_pushnil(L);
+		lua_pushstring(L, "timeout not supported on this platform");
+		return 2;
+	}
+	int err = sigwait(&set, &signum);
+	if (err != 0) {
+		errno = err;
+		signum = -1;
+	} else {
+		info.si_signo = signum;
+	}
+#else
+	struct timespec deadline, ts;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += (time_t)(timeout / 1000);
+	deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	for (;;) {
+		if (timeout < 0) {
+			signum = sigwaitinfo(&set, &info);
+		} else {
+			// interrupted waits continue with remaining time only
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_sec = deadline.tv_sec - ts.tv_sec;
+			ts.tv_nsec = deadline.tv_nsec - ts.tv_nsec;
+			if (ts.tv_nsec < 0) {
+				ts.tv_sec--;
+				ts.tv_nsec += 1000000000L;
+			}
+			if (ts.tv_sec < 0) {
+				ts.tv_sec = 0;
+				ts.tv_nsec = 0;
+			}
+			signum = sigtimedwait(&set, &info, &ts);
+		}
+		if (signum != -1 || errno != EINTR) {
+			break;
+		}
+	}
+#endif
+	int err_code = errno;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (signum == -1) {
+		errno = err_code;
+		if (errno == EAGAIN) {
+			lua_pushnil(L);
+			lua_pushstring(L, "timeout");
+			return 2;
+		}
+		return push_error(L, "failed to wait for signal");
+	}
+	signal_info payload;
+	signal_info_from_siginfo(&payload, &info);
+	lua_pushinteger(L, signum);
+	push_signal_info(L, &payload);
+	return 2;
+#endif
+}
+
+#ifdef LUA_USE_POSIX
+// dedicated thread receiving blocked signals with sigwait
+static pthread_t dispatcher_thread;
+static int dispatcher_running = 0; // guarded by registry lock
+static sigset_t dispatcher_set, dispatcher_old_mask;
+static pthread_t dispatcher_owner; // thread whose mask dispatcher changed
+static int dispatcher_wake_signum;
+static atomic_int dispatcher_stop;
+
+static void *signal_dispatcher_main(void *arg)
+{
+	(void)arg;
+	while (!atomic_load(&dispatcher_stop)) {
+		signal_event event;
+		memset(&event, 0, sizeof(event));
+#ifdef __APPLE__
+		// no sigwaitinfo, signals come without payload
+		if (sigwait(&dispatcher_set, &event.signum) != 0) {
+			continue;
+		}
+#else
+		siginfo_t info;
+		event.signum = sigwaitinfo(&dispatcher_set, &info);
+		if (event.signum == -1) {
+			continue;
+		}
+		event.has_info = 1;
+		signal_info_from_siginfo(&event.info, &info);
+#endif
+		if (atomic_load(&dispatcher_stop)) {
+			break;
+		}
+		trigger_signal_event(&event);
+	}
+	return NULL;
+}
+#endif
+
+/*
+---#DES 'signal.start_dispatcher'
+---
+---Moves delivery of signals in `set` (default all currently handled) to a
+---dedicated native thread. Signals are blocked with pthread_sigmask in the
+---calling thread (and threads it creates afterwards) and received with
+---sigwait, so blocking syscalls of lua code never fail with EINTR. Events
+---reach lua states through the usual queue/hook/fd path, the thread owning
+---a state is woken with SIGURG which therefore can not be dispatched.
+---On windows console events already arrive on their own thread, so this
+---is a no-op.
+---Returns true on success, otherwise nil, error desc and errno.
+---@param set integer[]?
+---@return boolean?, string?, integer?
+*/
+static int eli_os_signal_start_dispatcher(lua_State *L)
+{
+#ifdef LUA_USE_POSIX
+	sigset_t set;
+	sigemptyset(&set);
+	int wake_signum = 0;
+	if (!lua_isnoneornil(L, 1)) {
+		luaL_checktype(L, 1, LUA_TTABLE);
+		size_t count = lua_rawlen(L, 1);
+		for (size_t i = 1; i <= count; i++) {
+			lua_rawgeti(L, 1, i);
+			int signum = (int)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			luaL_argcheck(L, signum > 0 && signum < ELI_SIGNAL_MAX,
+				      1, "invalid signal");
+			luaL_argcheck(L, signum != ELI_SIGNAL_KICK, 1,
+				      "signal reserved for waking lua states");
+			sigaddset(&set, signum);
+			wake_signum = signum;
+		}
+	}
+
+	signal_registry_acquire();
+	if (dispatcher_running) {
+		signal_registry_release();
+		lua_pushnil(L);
+		lua_pushstring(L, "dispatcher already running");
+		return 2;
+	}
+	if (wake_signum == 0) {
+		for (int signum = 1; signum < ELI_SIGNAL_MAX; signum++) {
+			// kicks must reach their thread, never the dispatcher
+			if (signum != ELI_SIGNAL_KICK &&
+			    signal_subscribers[signum] > 0) {
+				sigaddset(&set, signum);
+				wake_signum = signum;
+			}
+		}
+	}
+	if (wake_signum == 0) {
+		signal_registry_release();
+		lua_pushnil(L);
+		lua_pushstring(L, "no signals to dispatch");
+		return 2;
+	}
+	dispatcher_set = set;
+	dispatcher_wake_signum = wake_signum;
+	atomic_store(&dispatcher_stop, 0);
+	int err = pthread_sigmask(SIG_BLOCK, &set, &dispatcher_old_mask);
+	dispatcher_owner = pthread_self();
+	if (err == 0) {
+		err = pthread_create(&dispatcher_thread, NULL,
+				     signal_dispatcher_main, NULL);
+		if (err != 0) {
+			pthread_sigmask(SIG_SETMASK, &dispatcher_old_mask,
+					NULL);
+		}
+	}
+	dispatcher_running = err == 0;
+	signal_registry_release();
+	if (err != 0) {
+		errno = err;
+		return push_error(L, "failed to start signal dispatcher");
+	}
+#endif
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+---#DES 'signal.stop_dispatcher'
+---
+---Stops dispatcher thread. Its signals are unblocked again only if called
+---from the thread which started the dispatcher (signal masks are per
+---thread), other threads keep them blocked.
+---@return boolean
+*/
+static int eli_os_signal_stop_dispatcher(lua_State *L)
+{
+#ifdef LUA_USE_POSIX
+	signal_registry_acquire();
+	int running = dispatcher_running;
+	dispatcher_running = 0;
+	signal_registry_release();
+	if (running) {
+		atomic_store(&dispatcher_stop, 1);
+		// wake sigwait up with a signal it is waiting for
+		pthread_kill(dispatcher_thread, dispatcher_wake_signum);
+		pthread_join(dispatcher_thread, NULL);
+		// masks are per thread, another thread can not restore it
+		if (pthread_equal(pthread_self(), dispatcher_owner)) {
+			pthread_sigmask(SIG_SETMASK, &dispatcher_old_mask,
+					NULL);
+		}
+	}
+	lua_pushboolean(L, running);
+#else
+	lua_pushboolean(L, 0);
+#endif
+	return 1;
+}
+
+/*
+---#DES 'signal.set_ctrl_budget'
+---
+---Sets how long (ms) console handler waits for handlers of CTRL_CLOSE,
+---CTRL_LOGOFF and CTRL_SHUTDOWN events, windows terminates the process once
+---it returns (about 5 s after CTRL_CLOSE). 0 does not wait. Default 4500.
+---Returns previous budget.
+---@param ms integer
+---@return integer
+*/
+static int eli_os_signal_set_ctrl_budget(lua_State *L)
+{
+	lua_Integer ms = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, ms >= 0 && ms <= INT_MAX, 1, "invalid budget");
+	lua_pushinteger(L, atomic_exchange(&ctrl_budget_ms, (int)ms));
+	return 1;
+}
+
+/*
+---#DES 'signal.dropped'
+---
+---Returns number of signals dropped because the signal queue was full.
+---@return integer
+*/
+static int eli_os_signal_dropped(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	lua_pushinteger(L, atomic_load_explicit(&st->dropped,
+						memory_order_relaxed));
+	return 1;
+}
+
+/*
+---#DES 'signal.stats'
+---
+---Returns delivery counters of the current lua state since start or last
+---signal.reset_stats: `max_depth` of the signal queue and per signal
+---(only those which were received) counts of received, dispatched,
+---dropped (queue full) and coalesced (merged into pending) occurrences,
+---handler errors and cumulative latency from arrival to handler return.
+---@return { max_depth: integer, signals: table<integer, { received: integer, dispatched: integer, dropped: integer, coalesced: integer, errors: integer, latency_ns: integer }> }
+*/
+static int eli_os_signal_stats(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	lua_createtable(L, 0, 2);
+	lua_pushinteger(L, atomic_load_explicit(&st->max_depth,
+						memory_order_relaxed));
+	lua_setfield(L, -2, "max_depth");
+	lua_newtable(L);
+	for (int signum = 1; signum < ELI_SIGNAL_MAX; signum++) {
+		signal_counters *stats = &st->stats[signum];
+		unsigned int received = atomic_load_explicit(
+			&stats->received, memory_order_relaxed);
+		if (received == 0 && stats->dispatched == 0) {
+			continue;
+		}
+		lua_createtable(L, 0, 6);
+		lua_pushinteger(L, received);
+		lua_setfield(L, -2, "received");
+		lua_pushinteger(L, stats->dispatched);
+		lua_setfield(L, -2, "dispatched");
+		lua_pushinteger(L, atomic_load_explicit(&stats->dropped,
+							memory_order_relaxed));
+		lua_setfield(L, -2, "dropped");
+		lua_pushinteger(L, atomic_load_explicit(&stats->coalesced,
+							memory_order_relaxed));
+		lua_setfield(L, -2, "coalesced");
+		lua_pushinteger(L, stats->errors);
+		lua_setfield(L, -2, "errors");
+		lua_pushinteger(L, (lua_Integer)stats->latency_ns);
+		lua_setfield(L, -2, "latency_ns");
+		lua_rawseti(L, -2, signum);
+	}
+	lua_setfield(L, -2, "signals");
+	return 1;
+}
+
+/*
+---#DES 'signal.reset_stats'
+---
+---Zeroes counters reported by signal.stats. signal.dropped is kept.
+*/
+static int eli_os_signal_reset_stats(lua_State *L)
+{
+	signal_state *st = get_signal_state(L);
+	for (int signum = 0; signum < ELI_SIGNAL_MAX; signum++) {
+		signal_counters *stats = &st->stats[signum];
+		atomic_store_explicit(&stats->received, 0,
+				      memory_order_relaxed);
+		atomic_store_explicit(&stats->dropped, 0, memory_order_relaxed);
+		atomic_store_explicit(&stats->coalesced, 0,
+				      memory_order_relaxed);
+		stats->dispatched = 0;
+		stats->errors = 0;
+		stats->latency_ns = 0;
+	}
+	atomic_store_explicit(&st->max_depth, 0, memory_order_relaxed);
+	return 0;
+}
+
+static const struct luaL_Reg eliOsSignal[] = {
+	{ "handle", eli_os_signal_handle },
+	{ "reset", eli_os_signal_reset },
+	{ "add_handler", eli_os_signal_add_handler },
+	{ "remove_handler", eli_os_signal_remove_handler },
+	{ "handle_many", eli_os_signal_handle_many },
+	{ "reset_many", eli_os_signal_reset_many },
+	{ "handlers", eli_os_signal_handlers },
+	{ "is_handled", eli_os_signal_is_handled },
+	{ "raise", eli_os_signal_raise },
+	{ "queue", eli_os_signal_queue },
+	{ "send", eli_os_signal_send },
+	{ "send_group", eli_os_signal_send_group },
+	{ "watch_child", eli_os_signal_watch_child },
+	{ "unwatch_child", eli_os_signal_unwatch_child },
+	{ "set_ctrl_budget", eli_os_signal_set_ctrl_budget },
+	{ "dropped", eli_os_signal_dropped },
+	{ "stats", eli_os_signal_stats },
+	{ "reset_stats", eli_os_signal_reset_stats },
+	{ "set_dispatch", eli_os_signal_set_dispatch },
+	{ "dispatch", eli_os_signal_dispatch },
+	{ "block", eli_os_signal_block },
+	{ "unblock", eli_os_signal_unblock },
+	{ "defer", eli_os_signal_defer },
+	{ "await", eli_os_signal_await },
+	{ "fd", eli_os_signal_fd },
+	{ "drain", eli_os_signal_drain },
+	{ "wait", eli_os_signal_wait },
+	{ "start_dispatcher", eli_os_signal_start_dispatcher },
+	{ "stop_dispatcher", eli_os_signal_stop_dispatcher },
+	{ NULL, NULL },
+};
+
+static const struct {
+	const char *name;
+	int signum;
+} eliOsSignalConstants[] = {
+	{ "SIGTERM", SIGTERM },
+	{ "SIGINT", SIGINT },
+#ifdef SIGKILL
+	{ "SIGKILL", SIGKILL },
+#else
+	{ "SIGKILL", 9 },
+#endif
+#ifdef SIGPIPE
+	{ "SIGPIPE", SIGPIPE },
+#else
+	{ "SIGPIPE", 13 },
+#endif
+#ifdef SIGBREAK
+	{ "SIGBREAK", SIGBREAK },
+#else
+	{ "SIGBREAK", 21 }, // windows
+#endif
+#ifdef SIGABRT
+	{ "SIGABRT", SIGABRT },
+#endif
+#ifdef SIGALRM
+	{ "SIGALRM", SIGALRM },
+#endif
+#ifdef SIGBUS
+	{ "SIGBUS", SIGBUS },
+#endif
+#ifdef SIGCHLD
+	{ "SIGCHLD", SIGCHLD },
+#endif
+#ifdef SIGCONT
+	{ "SIGCONT", SIGCONT },
+#endif
+#ifdef SIGEMT
+	{ "SIGEMT", SIGEMT },
+#endif
+#ifdef SIGFPE
+	{ "SIGFPE", SIGFPE },
+#endif
+#ifdef SIGHUP
+	{ "SIGHUP", SIGHUP },
+#endif
+#ifdef SIGILL
+	{ "SIGILL", SIGILL },
+#endif
+#ifdef SIGINFO
+	{ "SIGINFO", SIGINFO },
+#endif
+#ifdef SIGIO
+	{ "SIGIO", SIGIO },
+#endif
+#ifdef SIGPOLL
+	{ "SIGPOLL", SIGPOLL },
+#endif
+#ifdef SIGPROF
+	{ "SIGPROF", SIGPROF },
+#endif
+#ifdef SIGPWR
+	{ "SIGPWR", SIGPWR },
+#endif
+#ifdef SIGQUIT
+	{ "SIGQUIT", SIGQUIT },
+#endif
+#ifdef SIGSEGV
+	{ "SIGSEGV", SIGSEGV },
+#endif
+#ifdef SIGSTKFLT
+	{ "SIGSTKFLT", SIGSTKFLT },
+#endif
+#ifdef SIGSTOP
+	{ "SIGSTOP", SIGSTOP },
+#endif
+#ifdef SIGSYS
+	{ "SIGSYS", SIGSYS },
+#endif
+#ifdef SIGTRAP
+	{ "SIGTRAP", SIGTRAP },
+#endif
+#ifdef SIGTSTP
+	{ "SIGTSTP", SIGTSTP },
+#endif
+#ifdef SIGTTIN
+	{ "SIGTTIN", SIGTTIN },
+#endif
+#ifdef SIGTTOU
+	{ "SIGTTOU", SIGTTOU },
+#endif
+#ifdef SIGURG
+	{ "SIGURG", SIGURG },
+#endif
+#ifdef SIGUSR1
+	{ "SIGUSR1", SIGUSR1 },
+#endif
+#ifdef SIGUSR2
+	{ "SIGUSR2", SIGUSR2 },
+#endif
+#ifdef SIGVTALRM
+	{ "SIGVTALRM", SIGVTALRM },
+#endif
+#ifdef SIGWINCH
+	{ "SIGWINCH", SIGWINCH },
+#endif
+#ifdef SIGXCPU
+	{ "SIGXCPU", SIGXCPU },
+#endif
+#ifdef SIGXFSZ
+	{ "SIGXFSZ", SIGXFSZ },
+#endif
+};
+
+static const struct {
+	const char *name;
+	int kind;
+} eliOsSignalCtrlKinds[] = {
+	{ "CTRL_C", SIGNAL_CTRL_C },
+	{ "CTRL_BREAK", SIGNAL_CTRL_BREAK },
+	{ "CTRL_CLOSE", SIGNAL_CTRL_CLOSE },
+	{ "CTRL_LOGOFF", SIGNAL_CTRL_LOGOFF },
+	{ "CTRL_SHUTDOWN", SIGNAL_CTRL_SHUTDOWN },
+};
+
+#define ELI_OS_SIGNAL_FUNCTIONS \
+	(sizeof(eliOsSignal) / sizeof(eliOsSignal[0]) - 1)
+#define ELI_OS_SIGNAL_CONSTANTS \
+	(sizeof(eliOsSignalConstants) / sizeof(eliOsSignalConstants[0]))
+#define ELI_OS_SIGNAL_CTRL_KINDS \
+	(sizeof(eliOsSignalCtrlKinds) / sizeof(eliOsSignalCtrlKinds[0]))
+// SIGRTMIN and SIGRTMAX are set at runtime
+#define ELI_OS_SIGNAL_FIELDS                                         \
+	(int)(ELI_OS_SIGNAL_FUNCTIONS + ELI_OS_SIGNAL_CONSTANTS + \
+	      ELI_OS_SIGNAL_CTRL_KINDS + 2)
+
+// every lua state (main or worker thread) opening "os.signal" gets its own
+// subscription, at most ELI_SIGNAL_MAX_STATES at the same time
+ELI_OS_EXTRA_API int luaopen_eli_os_signal(lua_State *L)
+{
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &signalStateKey) !=
+	    LUA_TUSERDATA) {
+		lua_pop(L, 1);
+		if (signal_state_new(L) == NULL) {
+			return luaL_error(
+				L, "too many lua states with os.signal open");
+		}
+		lua_pushvalue(L, -1);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &signalStateKey);
+	}
+
+	// sized up front, filling it must not rehash
+	lua_createtable(L, 0, ELI_OS_SIGNAL_FIELDS);
+	lua_pushvalue(L, -2);
+	luaL_setfuncs(L, eliOsSignal, 1);
+	lua_remove(L, -2);
+
+	// add signals known to the platform - SIGTERM, SIGKILL, SIGINT...
+	for (size_t i = 0; i < ELI_OS_SIGNAL_CONSTANTS; i++) {
+		lua_pushinteger(L, eliOsSignalConstants[i].signum);
+		lua_setfield(L, -2, eliOsSignalConstants[i].name);
+	}
+	// console control event kinds, only ever passed on windows
+	for (size_t i = 0; i < ELI_OS_SIGNAL_CTRL_KINDS; i++) {
+		lua_pushinteger(L, eliOsSignalCtrlKinds[i].kind);
+		lua_setfield(L, -2, eliOsSignalCtrlKinds[i].name);
+	}
+#ifdef SIGRTMIN
+	// not constants with glibc, the range is known only at runtime
+	lua_pushinteger(L, SIGRTMIN);
+	lua_setfield(L, -2, "SIGRTMIN");
+	lua_pushinteger(L, SIGRTMAX);
+	lua_setfield(L, -2, "SIGRTMAX");
+#endif
 	return 1;
 }
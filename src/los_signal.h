@@ -2,7 +2,10 @@
 #define LUA_OS_EXTRA_SIGNAL_H
 
 #include "lua.h"
+#include <stdint.h>
+#include "lexport.h"
 
-int luaopen_eli_os_signal(lua_State *L);
+ELI_OS_EXTRA_API int luaopen_eli_os_signal(lua_State *L);
+int64_t eli_signal_sleep_ns(lua_State *L, int64_t ns, int *signum);
 
 #endif // LUA_OS_EXTRA_SIGNAL_H
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "lauxlib.h"
+#include "lua.h"
+
+#include <errno.h>
+#include <math.h>
+#include "ltime.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <time.h>
+#endif
+
+#define NS_PER_SEC 1000000000LL
+
+/*
+** Reads unit or divider at unit_idx - "s" (default), "ms", "us", "ns" or an
+** integer divider of a second.
+*/
+lua_Number eli_check_duration_divider(lua_State *L, int unit_idx)
+{
+	if (lua_type(L, unit_idx) == LUA_TSTRING) {
+		static const char *const units[] = { "s", "ms", "us", "ns",
+						     NULL };
+		static const lua_Number dividers[] = { 1, 1e3, 1e6, 1e9 };
+		return dividers[luaL_checkoption(L, unit_idx, "s", units)];
+	}
+	if (lua_isnoneornil(L, unit_idx)) {
+		return 1;
+	}
+	lua_Integer divider = luaL_checkinteger(L, unit_idx);
+	luaL_argcheck(L, divider > 0, unit_idx, "divider must be positive");
+	return (lua_Number)divider;
+}
+
+/*
+** Reads duration at idx scaled by unit or divider at unit_idx and returns
+** it in nanoseconds. Fractional durations are kept.
+*/
+int64_t eli_check_duration_ns(lua_State *L, int idx, int unit_idx)
+{
+	lua_Number duration = luaL_checknumber(L, idx);
+	lua_Number divider = eli_check_duration_divider(L, unit_idx);
+	// NaN would fail both range checks below, its conversion is undefined;
+	// finite durations overflowing to inf are clamped
+	luaL_argcheck(L,
+		      duration == duration &&
+			      duration != (lua_Number)HUGE_VAL &&
+			      duration != -(lua_Number)HUGE_VAL,
+		      idx, "duration must be finite");
+	lua_Number ns = duration * (lua_Number)NS_PER_SEC / divider;
+	if (ns <= 0) {
+		return 0;
+	}
+	if (ns >= (lua_Number)INT64_MAX) {
+		return INT64_MAX;
+	}
+	return (int64_t)ns;
+}
+
+/*
+** Sleeps for ns nanoseconds, resuming after signal interruptions.
+** Returns 0 on success, -1 (errno set) on failure.
+*/
+int eli_sleep_ns(int64_t ns)
+{
+	if (ns <= 0) {
+		return 0;
+	}
+#ifdef _WIN32
+	HANDLE timer = CreateWaitableTimerExW(
+		NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+		TIMER_ALL_ACCESS);
+	if (timer == NULL) {
+		// high resolution timers need windows 10 1803+
+		timer = CreateWaitableTimerW(NULL, TRUE, NULL);
+		if (timer == NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)((ns + 99) / 100); /* relative, 100ns */
+	if (!SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+		CloseHandle(timer);
+		errno = EINVAL;
+		return -1;
+	}
+	WaitForSingleObject(timer, INFINITE);
+	CloseHandle(timer);
+	return 0;
+#else
+	struct timespec req, rem;
+	req.tv_sec = (time_t)(ns / NS_PER_SEC);
+	req.tv_nsec = (long)(ns % NS_PER_SEC);
+#if defined(__APPLE__)
+	while (nanosleep(&req, &rem) == -1) {
+		if (errno != EINTR) {
+			return -1;
+		}
+		req = rem;
+	}
+#else
+	int err;
+	while ((err = clock_nanosleep(CLOCK_MONOTONIC, 0, &req, &rem)) != 0) {
+		if (err != EINTR) {
+			errno = err;
+			return -1;
+		}
+		req = rem;
+	}
+#endif
+	return 0;
+#endif
+}
+
+/*
+** Monotonic clock in nanoseconds, the epoch is unspecified.
+*/
+int64_t eli_monotonic_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	// split to avoid overflowing counter * NS_PER_SEC
+	return (int64_t)(counter.QuadPart / freq.QuadPart) * NS_PER_SEC +
+	       (int64_t)(counter.QuadPart % freq.QuadPart) * NS_PER_SEC /
+		       freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+#endif
+}
+
+/*
+** Sleeps until monotonic clock (see eli_monotonic_ns) reaches deadline.
+** Returns 0 on success, -1 (errno set) on failure.
+*/
+int eli_sleep_until_ns(int64_t deadline)
+{
+#if defined(_WIN32) || defined(__APPLE__)
+	// no absolute sleep on the monotonic clock
+	return eli_sleep_ns(deadline - eli_monotonic_ns());
+#else
+	if (deadline <= 0) {
+		return 0;
+	}
+	struct timespec ts;
+	ts.tv_sec = (time_t)(deadline / NS_PER_SEC);
+	ts.tv_nsec = (long)(deadline % NS_PER_SEC);
+	int err;
+	// absolute deadline, restarting after EINTR does not drift
+	while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				      NULL)) != 0) {
+		if (err != EINTR) {
+			errno = err;
+			return -1;
+		}
+	}
+	return 0;
+#endif
+}
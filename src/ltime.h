@@ -0,0 +1,13 @@
+#ifndef LUA_OS_EXTRA_TIME_H
+#define LUA_OS_EXTRA_TIME_H
+
+#include "lua.h"
+#include <stdint.h>
+
+lua_Number eli_check_duration_divider(lua_State *L, int unit_idx);
+int64_t eli_check_duration_ns(lua_State *L, int idx, int unit_idx);
+int eli_sleep_ns(int64_t ns);
+int64_t eli_monotonic_ns(void);
+int eli_sleep_until_ns(int64_t deadline);
+
+#endif /* LUA_OS_EXTRA_TIME_H */
@@ -0,0 +1,338 @@
+#include "lauxlib.h"
+#include "lua.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include "lerror.h"
+#include "ltime.h"
+#include "ltimer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_MANUAL_RESET
+#define CREATE_WAITABLE_TIMER_MANUAL_RESET 0x00000001
+#endif
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/timerfd.h>
+#define ELI_TIMER_TIMERFD
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+	defined(__OpenBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#define ELI_TIMER_KQUEUE
+#endif
+
+#define TIMER_METATABLE "ELI_OS_TIMER"
+
+typedef struct eli_os_timer {
+#ifdef _WIN32
+	HANDLE handle;
+	int64_t next; // monotonic ns of next expected expiration
+#else
+	int fd; // timerfd or kqueue
+#endif
+	int64_t interval; // ns
+	int oneshot;
+	int fired; // oneshot expiration already consumed by wait
+	int closed;
+	lua_Integer overruns; // expirations missed between waits
+} eli_os_timer;
+
+static eli_os_timer *check_timer(lua_State *L)
+{
+	eli_os_timer *timer =
+		(eli_os_timer *)luaL_checkudata(L, 1, TIMER_METATABLE);
+	luaL_argcheck(L, !timer->closed, 1, "timer is closed");
+	return timer;
+}
+
+static int timer_arm(eli_os_timer *timer)
+{
+#if defined(_WIN32)
+	// manual reset, waits on fd() must not consume expiration of wait()
+	HANDLE handle = CreateWaitableTimerExW(
+		NULL, NULL,
+		CREATE_WAITABLE_TIMER_MANUAL_RESET |
+			CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+		TIMER_ALL_ACCESS);
+	if (handle == NULL) {
+		handle = CreateWaitableTimerW(NULL, TRUE, NULL);
+		if (handle == NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)((timer->interval + 99) / 100);
+	// period has ms granularity only
+	LONG period = timer->oneshot ?
+			      0 :
+			      (LONG)((timer->interval + 999999) / 1000000);
+	if (!SetWaitableTimer(handle, &due, period, NULL, NULL, FALSE)) {
+		CloseHandle(handle);
+		errno = EINVAL;
+		return -1;
+	}
+	timer->handle = handle;
+	timer->next = eli_monotonic_ns() + timer->interval;
+	return 0;
+#elif defined(ELI_TIMER_TIMERFD)
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	struct itimerspec spec;
+	spec.it_value.tv_sec = (time_t)(timer->interval / 1000000000LL);
+	spec.it_value.tv_nsec = (long)(timer->interval % 1000000000LL);
+	if (timer->oneshot) {
+		spec.it_interval.tv_sec = 0;
+		spec.it_interval.tv_nsec = 0;
+	} else {
+		spec.it_interval = spec.it_value;
+	}
+	if (timerfd_settime(fd, 0, &spec, NULL) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	timer->fd = fd;
+	return 0;
+#elif defined(ELI_TIMER_KQUEUE)
+	int fd = kqueue();
+	if (fd == -1) {
+		return -1;
+	}
+	struct kevent change;
+#ifdef NOTE_NSECONDS
+	EV_SET(&change, 1, EVFILT_TIMER,
+	       EV_ADD | EV_ENABLE | (timer->oneshot ? EV_ONESHOT : 0),
+	       NOTE_NSECONDS, timer->interval, NULL);
+#else
+	EV_SET(&change, 1, EVFILT_TIMER,
+	       EV_ADD | EV_ENABLE | (timer->oneshot ? EV_ONESHOT : 0), 0,
+	       (timer->interval + 999999) / 1000000, NULL);
+#endif
+	if (kevent(fd, &change, 1, NULL, 0, NULL) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	timer->fd = fd;
+	return 0;
+#else
+	(void)timer;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void timer_close(eli_os_timer *timer)
+{
+	if (timer->closed) {
+		return;
+	}
+	timer->closed = 1;
+#ifdef _WIN32
+	CloseHandle(timer->handle);
+#else
+	close(timer->fd);
+#endif
+}
+
+/*
+---#DES 'os.timer'
+---
+---Creates timer expiring every `interval` (or once with `oneshot`) backed
+---by timerfd (linux), kqueue (bsd/macos) or waitable timer (windows).
+---`unit` follows os.sleep units, default "s".
+---Returns timer or nil, error desc and errno.
+---@param interval number
+---@param options { unit: '"s"' | '"ms"' | '"us"' | '"ns"' | integer | nil, oneshot: boolean? }?
+---@return EliOsTimer?, string?, integer?
+*/
+int eli_timer(lua_State *L)
+{
+	int oneshot = 0;
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		lua_getfield(L, 2, "oneshot");
+		oneshot = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "unit");
+	} else {
+		lua_pushnil(L);
+	}
+	int64_t interval = eli_check_duration_ns(L, 1, lua_gettop(L));
+	lua_pop(L, 1);
+	luaL_argcheck(L, interval > 0, 1, "interval must be positive");
+
+	eli_os_timer *timer = (eli_os_timer *)lua_newuserdatauv(
+		L, sizeof(eli_os_timer), 0);
+	timer->interval = interval;
+	timer->oneshot = oneshot;
+	timer->fired = 0;
+	timer->overruns = 0;
+	timer->closed = 1; /* until armed, nothing to release in __gc */
+	luaL_setmetatable(L, TIMER_METATABLE);
+	if (timer_arm(timer) != 0) {
+		return push_error(L, "failed to create timer");
+	}
+	timer->closed = 0;
+	return 1;
+}
+
+/*
+---#DES 'EliOsTimer:wait'
+---
+---Blocks until the timer expires. Returns number of expirations since
+---previous wait (more than 1 means ticks were missed, see `overruns`).
+---Returns nil, error desc and errno on failure, nil and error desc once a
+---oneshot timer was already waited for.
+---@param self EliOsTimer
+---@return integer?, string?, integer?
+*/
+static int timer_wait(lua_State *L)
+{
+	eli_os_timer *timer = check_timer(L);
+	if (timer->fired) {
+		// would block forever on every backend
+		lua_pushnil(L);
+		lua_pushstring(L, "oneshot timer already expired");
+		return 2;
+	}
+	uint64_t expirations = 0;
+#if defined(_WIN32)
+	if (WaitForSingleObject(timer->handle, INFINITE) != WAIT_OBJECT_0) {
+		errno = EINVAL;
+		return push_error(L, "failed to wait for timer");
+	}
+	// waitable timers do not count, derive from the schedule
+	int64_t now = eli_monotonic_ns();
+	expirations = 1;
+	if (!timer->oneshot && now > timer->next) {
+		expirations += (uint64_t)((now - timer->next) / timer->interval);
+	}
+	timer->next += (int64_t)expirations * timer->interval;
+	if (!timer->oneshot) {
+		// rescheduling is the only way to reset a manual reset timer
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((timer->next - now + 99) / 100);
+		LONG period = (LONG)((timer->interval + 999999) / 1000000);
+		if (!SetWaitableTimer(timer->handle, &due, period, NULL, NULL,
+				      FALSE)) {
+			errno = EINVAL;
+			return push_error(L, "failed to rearm timer");
+		}
+	}
+#elif defined(ELI_TIMER_TIMERFD)
+	for (;;) {
+		ssize_t nread =
+			read(timer->fd, &expirations, sizeof(expirations));
+		if (nread == sizeof(expirations)) {
+			break;
+		}
+		if (nread == -1 && errno != EAGAIN && errno != EINTR) {
+			return push_error(L, "failed to wait for timer");
+		}
+		struct pollfd pfd;
+		pfd.fd = timer->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+			return push_error(L, "failed to wait for timer");
+		}
+	}
+#elif defined(ELI_TIMER_KQUEUE)
+	struct kevent event;
+	int res;
+	do {
+		res = kevent(timer->fd, NULL, 0, &event, 1, NULL);
+	} while (res == -1 && errno == EINTR);
+	if (res == -1) {
+		return push_error(L, "failed to wait for timer");
+	}
+	expirations = (uint64_t)event.data;
+#endif
+	timer->fired = timer->oneshot;
+	if (expirations > 1) {
+		timer->overruns += (lua_Integer)(expirations - 1);
+	}
+	lua_pushinteger(L, (lua_Integer)expirations);
+	return 1;
+}
+
+/*
+---#DES 'EliOsTimer:fd'
+---
+---Returns pollable object readable on expiration - timerfd/kqueue fd or
+---timer HANDLE (light userdata) on windows. Call `wait` once it is ready.
+---@param self EliOsTimer
+---@return integer|lightuserdata
+*/
+static int timer_fd(lua_State *L)
+{
+	eli_os_timer *timer = check_timer(L);
+#ifdef _WIN32
+	lua_pushlightuserdata(L, timer->handle);
+#else
+	lua_pushinteger(L, timer->fd);
+#endif
+	return 1;
+}
+
+/*
+---#DES 'EliOsTimer:overruns'
+---
+---Returns total number of expirations missed between waits.
+---@param self EliOsTimer
+---@return integer
+*/
+static int timer_overruns(lua_State *L)
+{
+	eli_os_timer *timer = check_timer(L);
+	lua_pushinteger(L, timer->overruns);
+	return 1;
+}
+
+/*
+---#DES 'EliOsTimer:close'
+---
+---Stops the timer and releases its resources.
+---@param self EliOsTimer
+*/
+static int timer_gc(lua_State *L)
+{
+	eli_os_timer *timer =
+		(eli_os_timer *)luaL_checkudata(L, 1, TIMER_METATABLE);
+	timer_close(timer);
+	return 0;
+}
+
+static const struct luaL_Reg timerMethods[] = {
+	{ "wait", timer_wait },
+	{ "fd", timer_fd },
+	{ "overruns", timer_overruns },
+	{ "close", timer_gc },
+	{ NULL, NULL },
+};
+
+void eli_timer_create_meta(lua_State *L)
+{
+	luaL_newmetatable(L, TIMER_METATABLE);
+	lua_newtable(L);
+	luaL_setfuncs(L, timerMethods, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, timer_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_pushcfunction(L, timer_gc);
+	lua_setfield(L, -2, "__close");
+	lua_pop(L, 1);
+}
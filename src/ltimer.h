@@ -0,0 +1,9 @@
+#ifndef LUA_OS_EXTRA_TIMER_H
+#define LUA_OS_EXTRA_TIMER_H
+
+#include "lua.h"
+
+int eli_timer(lua_State *L);
+void eli_timer_create_meta(lua_State *L);
+
+#endif /* LUA_OS_EXTRA_TIMER_H */